@@ -1,27 +1,16 @@
 #include "MPC.h"
 #include <cppad/cppad.hpp>
 #include <cppad/ipopt/solve.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include "tools.h"
 
 using std::list;
 using std::vector;
 using CppAD::AD;
 
-// The timestep length and duration
-const size_t solver_N = 12;
-const double solver_dt = 0.1;
-
-// This value assumes the model presented in the classroom is used.
-//
-// It was obtained by measuring the radius formed by running the vehicle in the
-// simulator around in a circle with a constant steering angle and velocity on a
-// flat terrain.
-//
-// Lf was tuned until the the radius formed by the simulating the model
-// presented in the classroom matched the previous radius.
-//
-// This is the length from front to CoG that has a similar radius.
-const double Lf = 2.67; // meter
-
 const double max_delta = 0.436332;
 const double max_acc = 1.0;
 
@@ -36,19 +25,42 @@ const double speed_limit = 70 / mps_to_mph; // meter/sec
 // The solver takes all the state variables and actuator
 // variables in a singular vector. Thus, we should to establish
 // when one variable starts and another ends to make our lifes easier.
-const size_t x_start = 0;
-const size_t y_start = x_start + solver_N;
-const size_t psi_start = y_start + solver_N;
-const size_t v_start = psi_start + solver_N;
-const size_t cte_start = v_start + solver_N;
-const size_t epsi_start = cte_start + solver_N;
-const size_t delta_start = epsi_start + solver_N;
-const size_t a_start = delta_start + solver_N - 1;
-const size_t n_vars = a_start + solver_N - 1;
-
-const size_t n_constraints = delta_start;
-
-AD<double> polyeval_AD(const Eigen::VectorXd & coeffs, const AD<double> & x) {
+struct CartesianLayout {
+  explicit CartesianLayout(size_t N) :
+    x_start(0),
+    y_start(x_start + N),
+    psi_start(y_start + N),
+    v_start(psi_start + N),
+    cte_start(v_start + N),
+    epsi_start(cte_start + N),
+    delta_start(epsi_start + N),
+    a_start(delta_start + N - 1),
+    n_vars(a_start + N - 1),
+    n_constraints(delta_start) {}
+
+  const size_t x_start;
+  const size_t y_start;
+  const size_t psi_start;
+  const size_t v_start;
+  const size_t cte_start;
+  const size_t epsi_start;
+  const size_t delta_start;
+  const size_t a_start;
+  const size_t n_vars;
+  const size_t n_constraints;
+};
+
+double polyeval(const Eigen::VectorXd & coeffs, double x) {
+  double result = 0.0;
+  int sz = coeffs.size();
+  for (int i = 0; i < sz; i++) {
+    result += coeffs[i] * pow(x, i);
+  }
+  return result;
+}
+
+template <class Coeffs>
+AD<double> polyeval_AD(const Coeffs & coeffs, const AD<double> & x) {
   AD<double> result = 0.0;
   int sz = coeffs.size();
   for (int i = 0; i < sz; i++) {
@@ -57,13 +69,26 @@ AD<double> polyeval_AD(const Eigen::VectorXd & coeffs, const AD<double> & x) {
   return result;
 }
 
+// `Coeffs` is `Eigen::VectorXd` for solving, and a vector of `AD<double>` for
+// differentiating with respect to the coefficients and speed reference too.
+template <class Coeffs>
 class FG_eval {
  public:
+  // Horizon and cost weights
+  const MPCConfig & config;
+  const CartesianLayout layout;
+
   // Fitted polynomial coefficients
-  const Eigen::VectorXd & coeffs;
+  const Coeffs & coeffs;
+
+  // Target speed at each timestep
+  const Coeffs & speed_reference;
 
-  FG_eval(const Eigen::VectorXd & coeffs_) :
-    coeffs(coeffs_) {}
+  FG_eval(const MPCConfig & config_, const Coeffs & coeffs_, const Coeffs & speed_reference_) :
+    config(config_),
+    layout(config_.N),
+    coeffs(coeffs_),
+    speed_reference(speed_reference_) {}
 
   typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
 
@@ -78,26 +103,26 @@ class FG_eval {
     // standard deviation, so that all squared values are weighted somewhat equally.
     // Then adjust the multipliers for the squared terms. With normalization,
     // it's easier to estimate the effect of each multiplier.
-    for (unsigned int t = 0; t < solver_N; t++) {
-      fg[0] += 50 * (solver_N - t) * CppAD::pow(vars[cte_start + t] / std_cte, 2); // Penalize cte at the proximal end with higher weights.
-      fg[0] += 2 * CppAD::pow(vars[epsi_start + t] / std_epsi, 2);
-      fg[0] += 50 * CppAD::pow((vars[v_start + t] - speed_limit) / speed_limit, 2); // Aside from targeting the speed limit, also prevent coming to a stop.
+    for (unsigned int t = 0; t < config.N; t++) {
+      fg[0] += config.cte_weight * (config.N - t) * CppAD::pow(vars[layout.cte_start + t] / std_cte, 2); // Penalize cte at the proximal end with higher weights.
+      fg[0] += config.epsi_weight * CppAD::pow(vars[layout.epsi_start + t] / std_epsi, 2);
+      fg[0] += config.speed_weight * CppAD::pow((vars[layout.v_start + t] - speed_reference[t]) / speed_limit, 2); // Aside from targeting the reference speed, also prevent coming to a stop.
     }
-    for (unsigned int t = 0; t < solver_N - 1; t++) {
-      fg[0] += 5 * CppAD::pow(vars[delta_start + t] / max_delta, 2);
-      fg[0] += 1 * CppAD::pow(vars[a_start + t] / max_acc, 2);
+    for (unsigned int t = 0; t < config.N - 1; t++) {
+      fg[0] += config.steering_weight * CppAD::pow(vars[layout.delta_start + t] / max_delta, 2);
+      fg[0] += config.acceleration_weight * CppAD::pow(vars[layout.a_start + t] / max_acc, 2);
 
       // // Reduce correlation wide steering and large speed.
       // // Take square of steering in order to ignore sign.
       // // Disabled because empirically it did not improve optimized trajectories.
       // double relative_importance_of_speed = 3;
       // fg[0] += 0.1 *
-      //   CppAD::pow(vars[delta_start + t] / max_delta, 2) *
-      //   CppAD::pow(vars[v_start + t + 1] / speed_limit * relative_importance_of_speed, 2);
+      //   CppAD::pow(vars[layout.delta_start + t] / max_delta, 2) *
+      //   CppAD::pow(vars[layout.v_start + t + 1] / speed_limit * relative_importance_of_speed, 2);
     }
-    for (unsigned int t = 0; t < solver_N - 2; t++) {
-      fg[0] += 50 * CppAD::pow((vars[delta_start + t + 1] - vars[delta_start + t]) / std_ddelta_dt, 2);
-      fg[0] += 1 * CppAD::pow((vars[a_start + t + 1] - vars[a_start + t]) / std_dacc_dt, 2);
+    for (unsigned int t = 0; t < config.N - 2; t++) {
+      fg[0] += config.steering_change_weight * CppAD::pow((vars[layout.delta_start + t + 1] - vars[layout.delta_start + t]) / std_ddelta_dt, 2);
+      fg[0] += config.acceleration_change_weight * CppAD::pow((vars[layout.a_start + t + 1] - vars[layout.a_start + t]) / std_dacc_dt, 2);
     }
 
     // Express constraints
@@ -106,53 +131,345 @@ class FG_eval {
     // This bumps up the positions of all the other values.
 
     // The constrained expressions for the initial timestep. Keep these constant while solving.
-    fg[1 + x_start] = vars[x_start];
-    fg[1 + y_start] = vars[y_start];
-    fg[1 + psi_start] = vars[psi_start];
-    fg[1 + v_start] = vars[v_start];
-    fg[1 + cte_start] = vars[cte_start];
-    fg[1 + epsi_start] = vars[epsi_start];
+    fg[1 + layout.x_start] = vars[layout.x_start];
+    fg[1 + layout.y_start] = vars[layout.y_start];
+    fg[1 + layout.psi_start] = vars[layout.psi_start];
+    fg[1 + layout.v_start] = vars[layout.v_start];
+    fg[1 + layout.cte_start] = vars[layout.cte_start];
+    fg[1 + layout.epsi_start] = vars[layout.epsi_start];
 
     // The constrained expressions for the future timesteps. Want to solve these expressions to be closer to zeros.
-    for (unsigned int t = 1; t < solver_N; t++) {
-      AD<double> x1 = vars[x_start + t];
-      AD<double> y1 = vars[y_start + t];
-      AD<double> psi1 = vars[psi_start + t];
-      AD<double> v1 = vars[v_start + t];
-      AD<double> cte1 = vars[cte_start + t];
-      AD<double> epsi1 = vars[epsi_start + t];
-
-      AD<double> x0 = vars[x_start + t - 1];
-      AD<double> y0 = vars[y_start + t - 1];
-      AD<double> psi0 = vars[psi_start + t - 1];
-      AD<double> v0 = vars[v_start + t - 1];
-      // AD<double> cte0 = vars[cte_start + t - 1]; // not used
-      AD<double> epsi0 = vars[epsi_start + t - 1];
-
-      AD<double> delta0 = vars[delta_start + t - 1];
-      AD<double> a0 = vars[a_start + t - 1];
+    for (unsigned int t = 1; t < config.N; t++) {
+      AD<double> x1 = vars[layout.x_start + t];
+      AD<double> y1 = vars[layout.y_start + t];
+      AD<double> psi1 = vars[layout.psi_start + t];
+      AD<double> v1 = vars[layout.v_start + t];
+      AD<double> cte1 = vars[layout.cte_start + t];
+      AD<double> epsi1 = vars[layout.epsi_start + t];
+
+      AD<double> x0 = vars[layout.x_start + t - 1];
+      AD<double> y0 = vars[layout.y_start + t - 1];
+      AD<double> psi0 = vars[layout.psi_start + t - 1];
+      AD<double> v0 = vars[layout.v_start + t - 1];
+      // AD<double> cte0 = vars[layout.cte_start + t - 1]; // not used
+      AD<double> epsi0 = vars[layout.epsi_start + t - 1];
+
+      AD<double> delta0 = vars[layout.delta_start + t - 1];
+      AD<double> a0 = vars[layout.a_start + t - 1];
 
       AD<double> desired_y0 = polyeval_AD(coeffs, x0);
       AD<double> desired_psi0 = CppAD::atan(coeffs[1]);
 
-      AD<double> helper_psi_term = v0 * delta0 / Lf * solver_dt;
-
-      fg[1 + x_start + t] = x1 - (x0 + v0 * CppAD::cos(psi0) * solver_dt);
-      fg[1 + y_start + t] = y1 - (y0 + v0 * CppAD::sin(psi0) * solver_dt);
-      fg[1 + psi_start + t] = psi1 - (psi0 + helper_psi_term);
-      fg[1 + v_start + t] = v1 - (v0 + a0 * solver_dt);
-      fg[1 + cte_start + t] = cte1 - ((desired_y0 - y0) + (v0 * CppAD::sin(epsi0) * solver_dt));
-      fg[1 + epsi_start + t] = epsi1 - ((psi0 - desired_psi0) + helper_psi_term);
+      VehicleState<AD<double>> next = step(VehicleState<AD<double>> {x0, y0, psi0, v0},
+                                            VehicleInput<AD<double>> {delta0, a0},
+                                            AD<double>(config.dt));
+
+      fg[1 + layout.x_start + t] = x1 - next.x;
+      fg[1 + layout.y_start + t] = y1 - next.y;
+      fg[1 + layout.psi_start + t] = psi1 - next.psi;
+      fg[1 + layout.v_start + t] = v1 - next.v;
+      fg[1 + layout.cte_start + t] = cte1 - ((desired_y0 - y0) + (v0 * CppAD::sin(epsi0) * config.dt));
+      // The heading error changes as much as the heading.
+      fg[1 + layout.epsi_start + t] = epsi1 - (next.psi - desired_psi0);
     }
   }
 };
 
+// options for IPOPT solver
+static std::string ipopt_options(double max_cpu_time) {
+  std::string options;
+  // Uncomment this if you'd like more print information
+  options += "Integer print_level  0\n";
+  // NOTE: Setting sparse to true allows the solver to take advantage
+  // of sparse routines, this makes the computation MUCH FASTER. If you
+  // can uncomment 1 of these and see if it makes a difference or not but
+  // if you uncomment both the computation time should go up in orders of
+  // magnitude.
+  options += "Sparse  true        forward\n";
+  options += "Sparse  true        reverse\n";
+  // NOTE: The solver has a maximum time limit, 0.5 seconds by default.
+  // Change this as you see fit.
+  options += "Numeric max_cpu_time          " + std::to_string(max_cpu_time) + "\n";
+  return options;
+}
+
+//
+// MPCConfig.
+//
+
+// The fields other than `N`, in declaration order.
+static const std::pair<const char *, double MPCConfig::*> config_fields[] = {
+  {"dt", &MPCConfig::dt},
+  {"cte_weight", &MPCConfig::cte_weight},
+  {"epsi_weight", &MPCConfig::epsi_weight},
+  {"speed_weight", &MPCConfig::speed_weight},
+  {"steering_weight", &MPCConfig::steering_weight},
+  {"acceleration_weight", &MPCConfig::acceleration_weight},
+  {"steering_change_weight", &MPCConfig::steering_change_weight},
+  {"acceleration_change_weight", &MPCConfig::acceleration_change_weight},
+  {"max_cpu_time", &MPCConfig::max_cpu_time},
+};
+
+bool MPCConfig::Set(const std::string & key, double value) {
+  if (key == "N") {
+    // The cost of the change of actuations needs at least two of them.
+    if (value < 3 || value != floor(value)) {
+      return false;
+    }
+    N = (size_t) value;
+    return true;
+  }
+  for (const auto & field : config_fields) {
+    if (key == field.first) {
+      // The weights may be 0, the durations may not.
+      bool is_duration = key == "dt" || key == "max_cpu_time";
+      if (!(is_duration ? value > 0 : value >= 0)) {
+        return false;
+      }
+      this->*field.second = value;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool MPCConfig::Parse(const std::string & assignments) {
+  std::istringstream in(assignments);
+  std::string assignment;
+  while (std::getline(in, assignment, ',')) {
+    size_t equals = assignment.find('=');
+    char *end = nullptr;
+    double value = equals == std::string::npos ? 0 :
+      strtod(assignment.c_str() + equals + 1, &end);
+    if (end == nullptr || *end != '\0' || end == assignment.c_str() + equals + 1 ||
+        !Set(assignment.substr(0, equals), value)) {
+      std::cerr << "Invalid MPC setting: " << assignment << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+const vector<std::string> & MPCConfig::Keys() {
+  static const vector<std::string> keys = []() {
+    vector<std::string> keys = {"N"};
+    for (const auto & field : config_fields) {
+      keys.push_back(field.first);
+    }
+    return keys;
+  }();
+  return keys;
+}
+
+vector<double> MPCConfig::Values() const {
+  vector<double> values = {(double) N};
+  for (const auto & field : config_fields) {
+    values.push_back(this->*field.second);
+  }
+  return values;
+}
+
 //
 // MPC class definition implementation.
 //
-MPC::MPC() {}
+MPC::MPC(const MPCConfig & config) :
+  config(config),
+  last_timings(),
+  sensitivity_max_change(0),
+  full_solve_interval(1),
+  cycles_since_full_solve(0),
+  has_kkt(false) {}
 MPC::~MPC() {}
 
+// CppAD keeps its tapes per thread, and needs to be told which thread it runs on.
+static bool cppad_in_parallel = false;
+static thread_local size_t cppad_thread_num = 0;
+
+static bool cppad_parallel_mode() {
+  return cppad_in_parallel;
+}
+
+static size_t cppad_thread_number() {
+  return cppad_thread_num;
+}
+
+void MPC::SetupThreads(size_t max_threads) {
+  CppAD::thread_alloc::parallel_setup(max_threads + 1, cppad_parallel_mode, cppad_thread_number);
+  CppAD::thread_alloc::hold_memory(true);
+  CppAD::parallel_ad<double>();
+  cppad_in_parallel = true;
+}
+
+void MPC::SetThreadNumber(size_t thread_num) {
+  cppad_thread_num = thread_num;
+}
+
+bool MPC::ActuationProfile(vector<double> & steering, vector<double> & acceleration) const {
+  const CartesianLayout layout(config.N);
+  if (warm_start.size() != layout.n_vars) {
+    return false;
+  }
+  steering.assign(warm_start.begin() + layout.delta_start, warm_start.begin() + layout.a_start);
+  acceleration.assign(warm_start.begin() + layout.a_start, warm_start.begin() + layout.n_vars);
+  return true;
+}
+
+void MPC::EnableSensitivityUpdates(double max_change, unsigned int full_solve_interval) {
+  sensitivity_max_change = max_change;
+  this->full_solve_interval = std::max(1u, full_solve_interval);
+  has_kkt = false;
+}
+
+/**
+ * The optimum `w` of the NLP, together with the multipliers `l` of its constraints,
+ * satisfies the KKT conditions
+ *
+ *   grad_w L(w, l, p) = 0
+ *   g(w, p) = 0
+ *
+ * where L = f + l' g is the Lagrangian, and `p` are the parameters, i.e. the initial
+ * state, the speed reference and the coefficients. Variables at a bound are held there,
+ * and left out.
+ * Differentiating the conditions by `p` gives the linear system
+ *
+ *   | H_ww  J_w' | | dw |     | H_wp |
+ *   | J_w   0    | | dl |  = -| J_p  | dp
+ *
+ * whose matrix is factorized here, once per full solve.
+ *
+ * For a variable `i` held at a bound, the left out row of the stationarity condition
+ * is its bound multiplier instead, z_i = grad_w_i L, non-negative at a lower bound and
+ * non-positive at an upper one. Its change dz_i = H_iw dw + J_i' dl + H_ip dp tells
+ * whether the variable would leave its bound.
+ */
+void MPC::FormKKT(const Eigen::VectorXd & params, const vector<double> & x,
+                  const vector<double> & lambda, const vector<double> & bound_multipliers,
+                  const vector<int> & at_bound) {
+  typedef CPPAD_TESTVECTOR(double) Dvector;
+  typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
+
+  const CartesianLayout layout(config.N);
+  const size_t n_params = params.size();
+  const size_t n = layout.n_vars + n_params;
+  const size_t n_state = 6;
+
+  // Tape the cost and constraints as functions of both the variables and the parameters.
+  // The constraints on the initial state become residuals against the parameters.
+  Dvector point(n);
+  for (size_t i = 0; i < layout.n_vars; i++) {
+    point[i] = x[i];
+  }
+  for (size_t k = 0; k < n_params; k++) {
+    point[layout.n_vars + k] = params[k];
+  }
+  ADvector ad_point(n);
+  for (size_t i = 0; i < n; i++) {
+    ad_point[i] = point[i];
+  }
+  CppAD::Independent(ad_point);
+
+  ADvector vars(layout.n_vars);
+  for (size_t i = 0; i < layout.n_vars; i++) {
+    vars[i] = ad_point[i];
+  }
+  ADvector speed_reference(config.N);
+  for (size_t t = 0; t < config.N; t++) {
+    speed_reference[t] = ad_point[layout.n_vars + n_state + t];
+  }
+  ADvector coeffs(n_params - n_state - config.N);
+  for (size_t k = 0; k < coeffs.size(); k++) {
+    coeffs[k] = ad_point[layout.n_vars + n_state + config.N + k];
+  }
+  ADvector fg(1 + layout.n_constraints);
+  FG_eval<ADvector> fg_eval(config, coeffs, speed_reference);
+  fg_eval(fg, vars);
+  for (size_t k = 0; k < n_state; k++) {
+    fg[1 + k * config.N] -= ad_point[layout.n_vars + k];
+  }
+  CppAD::ADFun<double> fun(ad_point, fg);
+
+  Dvector weights(1 + layout.n_constraints);
+  weights[0] = 1;
+  for (size_t c = 0; c < layout.n_constraints; c++) {
+    weights[1 + c] = lambda[c];
+  }
+  Dvector jac = fun.Jacobian(point); // row major, (1 + n_constraints) by n
+  Dvector hes = fun.Hessian(point, weights); // n by n
+
+  kkt_free.clear();
+  kkt_pinned.clear();
+  kkt_pinned_side.clear();
+  for (size_t i = 0; i < layout.n_vars; i++) {
+    if (at_bound[i] == 0) {
+      kkt_free.push_back(i);
+    } else {
+      kkt_pinned.push_back(i);
+      kkt_pinned_side.push_back(at_bound[i]);
+    }
+  }
+  const size_t n_free = kkt_free.size();
+  const size_t n_pinned = kkt_pinned.size();
+
+  Eigen::MatrixXd kkt = Eigen::MatrixXd::Zero(n_free + layout.n_constraints, n_free + layout.n_constraints);
+  kkt_dparams.resize(n_free + layout.n_constraints, n_params);
+  for (size_t a = 0; a < n_free; a++) {
+    for (size_t b = 0; b < n_free; b++) {
+      kkt(a, b) = hes[kkt_free[a] * n + kkt_free[b]];
+    }
+    for (size_t k = 0; k < n_params; k++) {
+      kkt_dparams(a, k) = hes[kkt_free[a] * n + layout.n_vars + k];
+    }
+  }
+  for (size_t c = 0; c < layout.n_constraints; c++) {
+    for (size_t a = 0; a < n_free; a++) {
+      kkt(n_free + c, a) = kkt(a, n_free + c) = jac[(1 + c) * n + kkt_free[a]];
+    }
+    for (size_t k = 0; k < n_params; k++) {
+      kkt_dparams(n_free + c, k) = jac[(1 + c) * n + layout.n_vars + k];
+    }
+  }
+
+  kkt_pinned_multipliers.resize(n_pinned);
+  kkt_pinned_dz = Eigen::MatrixXd::Zero(n_pinned, n_free + layout.n_constraints);
+  kkt_pinned_dparams.resize(n_pinned, n_params);
+  for (size_t a = 0; a < n_pinned; a++) {
+    size_t i = kkt_pinned[a];
+    kkt_pinned_multipliers[a] = bound_multipliers[i];
+    for (size_t b = 0; b < n_free; b++) {
+      kkt_pinned_dz(a, b) = hes[i * n + kkt_free[b]];
+    }
+    for (size_t c = 0; c < layout.n_constraints; c++) {
+      kkt_pinned_dz(a, n_free + c) = jac[(1 + c) * n + i];
+    }
+    for (size_t k = 0; k < n_params; k++) {
+      kkt_pinned_dparams(a, k) = hes[i * n + layout.n_vars + k];
+    }
+  }
+
+  kkt_lu.compute(kkt);
+  // A singular system, e.g. where bounds leave a constraint with no free variable,
+  // has no tangent; fall back to full solves until the next one.
+  has_kkt = kkt_lu.rcond() > 1e-12;
+  kkt_params = params;
+  kkt_solution.resize(layout.n_vars);
+  for (size_t i = 0; i < layout.n_vars; i++) {
+    kkt_solution[i] = x[i];
+  }
+}
+
+Eigen::VectorXd MPC::PredictChange(const Eigen::VectorXd & params,
+                                   Eigen::VectorXd & pinned_multipliers) const {
+  const CartesianLayout layout(config.N);
+  Eigen::VectorXd dp = params - kkt_params;
+  Eigen::VectorXd dz = kkt_lu.solve(-kkt_dparams * dp);
+  Eigen::VectorXd dw = Eigen::VectorXd::Zero(layout.n_vars);
+  for (size_t a = 0; a < kkt_free.size(); a++) {
+    dw[kkt_free[a]] = dz[a];
+  }
+  pinned_multipliers = kkt_pinned_multipliers + kkt_pinned_dz * dz + kkt_pinned_dparams * dp;
+  return dw;
+}
+
 /**
  * We will initialize the independent variables as:
  *
@@ -205,102 +522,501 @@ MPC::~MPC() {}
  * where dash means lack of limit, and non-dash means existence of limit.
  *
  * Out of the solution, we will return the actuation values at the first timestep.
+ *
+ * If a previous solution exists, it warm starts the independent variables instead of
+ * zeros: the actuations are shifted by one timestep (unless told otherwise), and the
+ * states are rolled out from the initial state by the same model as `FG_eval`.
+ *
+ * If sensitivity updates are enabled, the solution may instead be predicted from
+ * the last full solve, without running IPOPT. See `FormKKT`.
  */
 std::tuple<double, double, vector<double>, vector<double>>
-MPC::Solve(const vector<double> & init_state, const Eigen::VectorXd & coeffs) {
+MPC::Solve(const vector<double> & init_state, const Eigen::VectorXd & coeffs,
+           const Eigen::VectorXd & speed_reference, bool shift_warm_start) {
 
   typedef CPPAD_TESTVECTOR(double) Dvector;
 
+  auto mark = std::chrono::steady_clock::now();
+  last_timings = SolveTimings();
+
+  const CartesianLayout layout(config.N);
+
   // Initial values of the independent variables.
-  Dvector vars(n_vars);
-  for (unsigned int i = 0; i < n_vars; i++) {
+  Dvector vars(layout.n_vars);
+  for (unsigned int i = 0; i < layout.n_vars; i++) {
     vars[i] = 0.0;
   }
 
   // Lower and upper limits for the independent variables.
-  Dvector vars_lowerbound(n_vars);
-  Dvector vars_upperbound(n_vars);
+  Dvector vars_lowerbound(layout.n_vars);
+  Dvector vars_upperbound(layout.n_vars);
   // Set no limit for most of the state vars.
-  for (unsigned int i = 0; i < delta_start; i++) {
+  for (unsigned int i = 0; i < layout.delta_start; i++) {
     vars_lowerbound[i] = -1.0e19;
     vars_upperbound[i] = 1.0e19;
   }
   // Limit v by speed limit.
-  for (unsigned int i = v_start; i < cte_start; i++) {
+  for (unsigned int i = layout.v_start; i < layout.cte_start; i++) {
     vars_lowerbound[i] = -speed_limit; // backward speed
     vars_upperbound[i] = speed_limit;
   }
   // Limit steering to -25 and 25 degrees.
-  for (unsigned int i = delta_start; i < a_start; i++) {
+  for (unsigned int i = layout.delta_start; i < layout.a_start; i++) {
     vars_lowerbound[i] = -max_delta;
     vars_upperbound[i] = max_delta;
   }
   // Limit acceleration to -1 and 1 m/s.
-  for (unsigned int i = a_start; i < n_vars; i++) {
+  for (unsigned int i = layout.a_start; i < layout.n_vars; i++) {
     vars_lowerbound[i] = -max_acc;
     vars_upperbound[i] = max_acc;
   }
 
   // Lower and upper limits for the constraints.
   // For all expressions, both lower and upper limits are set to the same value.
-  Dvector constraints_lowerbound(n_constraints);
-  Dvector constraints_upperbound(n_constraints);
-  for (unsigned int i = 0; i < n_constraints; i++) {
+  Dvector constraints_lowerbound(layout.n_constraints);
+  Dvector constraints_upperbound(layout.n_constraints);
+  for (unsigned int i = 0; i < layout.n_constraints; i++) {
     constraints_lowerbound[i] = constraints_upperbound[i] = 0.0;
   }
 
+  Eigen::VectorXd v_ref = speed_reference.size() == (int) config.N ?
+    speed_reference : Eigen::VectorXd::Constant(config.N, speed_limit);
+
+  // The parameters of the problem.
+  Eigen::VectorXd params(init_state.size() + config.N + coeffs.size());
+  for (unsigned int k = 0; k < init_state.size(); k++) {
+    params[k] = init_state[k];
+  }
+  params.segment(init_state.size(), config.N) = v_ref;
+  params.tail(coeffs.size()) = coeffs;
+
+  if (sensitivity_max_change > 0 && has_kkt && params.size() == kkt_params.size() &&
+      cycles_since_full_solve + 1 < full_solve_interval) {
+    last_timings.setup = lap(mark);
+    Eigen::VectorXd pinned_multipliers;
+    Eigen::VectorXd predicted = kkt_solution + PredictChange(params, pinned_multipliers);
+
+    // The prediction is only valid if no bound becomes active, i.e. no free variable
+    // reaches its bound, or inactive, i.e. no held variable's multiplier changes sign,
+    // and only accurate if the actuations change little.
+    bool ok = true;
+    for (size_t a = 0; a < kkt_free.size() && ok; a++) {
+      size_t i = kkt_free[a];
+      ok = predicted[i] > vars_lowerbound[i] && predicted[i] < vars_upperbound[i];
+    }
+    for (size_t a = 0; a < kkt_pinned.size() && ok; a++) {
+      ok = kkt_pinned_side[a] * pinned_multipliers[a] <= 0;
+    }
+    for (unsigned int t = 0; t < config.N - 1 && ok; t++) {
+      double change = std::max(
+        fabs(predicted[layout.delta_start + t] - kkt_solution[layout.delta_start + t]) / (2 * max_delta),
+        fabs(predicted[layout.a_start + t] - kkt_solution[layout.a_start + t]) / (2 * max_acc));
+      ok = change <= sensitivity_max_change;
+    }
+
+    last_timings.optimize = lap(mark);
+    if (ok) {
+      cycles_since_full_solve++;
+      warm_start.resize(layout.n_vars);
+      for (unsigned int i = 0; i < layout.n_vars; i++) {
+        warm_start[i] = predicted[i];
+      }
+      vector<double> predicted_x(config.N), predicted_y(config.N);
+      for (unsigned int i = 0; i < config.N; i++) {
+        predicted_x[i] = predicted[layout.x_start + i];
+        predicted_y[i] = predicted[layout.y_start + i];
+      }
+      last_timings.extract = lap(mark);
+      return std::make_tuple(predicted[layout.delta_start], predicted[layout.a_start], predicted_x, predicted_y);
+    }
+    // A rejected update counts as setup of the full solve.
+    last_timings.setup += last_timings.optimize;
+  }
+
   // Set initial state values to vars and constraints.
-  vars[x_start] = constraints_lowerbound[x_start] = constraints_upperbound[x_start] = init_state[0];
-  vars[y_start] = constraints_lowerbound[y_start] = constraints_upperbound[y_start] = init_state[1];
-  vars[psi_start] = constraints_lowerbound[psi_start] = constraints_upperbound[psi_start] = init_state[2];
-  vars[v_start] = constraints_lowerbound[v_start] = constraints_upperbound[v_start] = init_state[3];
-  vars[cte_start] = constraints_lowerbound[cte_start] = constraints_upperbound[cte_start] = init_state[4];
-  vars[epsi_start] = constraints_lowerbound[epsi_start] = constraints_upperbound[epsi_start] = init_state[5];
+  vars[layout.x_start] = constraints_lowerbound[layout.x_start] = constraints_upperbound[layout.x_start] = init_state[0];
+  vars[layout.y_start] = constraints_lowerbound[layout.y_start] = constraints_upperbound[layout.y_start] = init_state[1];
+  vars[layout.psi_start] = constraints_lowerbound[layout.psi_start] = constraints_upperbound[layout.psi_start] = init_state[2];
+  vars[layout.v_start] = constraints_lowerbound[layout.v_start] = constraints_upperbound[layout.v_start] = init_state[3];
+  vars[layout.cte_start] = constraints_lowerbound[layout.cte_start] = constraints_upperbound[layout.cte_start] = init_state[4];
+  vars[layout.epsi_start] = constraints_lowerbound[layout.epsi_start] = constraints_upperbound[layout.epsi_start] = init_state[5];
+
+  if (warm_start.size() == layout.n_vars) {
+    for (unsigned int t = 0; t < config.N - 1; t++) {
+      unsigned int prev_t = shift_warm_start ? std::min(t + 1, (unsigned int) config.N - 2) : t;
+      vars[layout.delta_start + t] = warm_start[layout.delta_start + prev_t];
+      vars[layout.a_start + t] = warm_start[layout.a_start + prev_t];
+    }
+    double desired_psi = atan(coeffs[1]);
+    for (unsigned int t = 1; t < config.N; t++) {
+      double x0 = vars[layout.x_start + t - 1];
+      double y0 = vars[layout.y_start + t - 1];
+      double psi0 = vars[layout.psi_start + t - 1];
+      double v0 = vars[layout.v_start + t - 1];
+      double epsi0 = vars[layout.epsi_start + t - 1];
+      double delta0 = vars[layout.delta_start + t - 1];
+      double a0 = vars[layout.a_start + t - 1];
+
+      VehicleState<double> next = step(VehicleState<double> {x0, y0, psi0, v0},
+                                       VehicleInput<double> {delta0, a0}, config.dt);
+
+      vars[layout.x_start + t] = next.x;
+      vars[layout.y_start + t] = next.y;
+      vars[layout.psi_start + t] = next.psi;
+      vars[layout.v_start + t] = std::max(-speed_limit, std::min(speed_limit, next.v));
+      vars[layout.cte_start + t] = (polyeval(coeffs, x0) - y0) + v0 * sin(epsi0) * config.dt;
+      vars[layout.epsi_start + t] = next.psi - desired_psi;
+    }
+  }
 
   // object that computes objective and constraints
-  FG_eval fg_eval(coeffs);
+  FG_eval<Eigen::VectorXd> fg_eval(config, coeffs, v_ref);
 
   // options for IPOPT solver
-  std::string options;
-  // Uncomment this if you'd like more print information
-  options += "Integer print_level  0\n";
-  // NOTE: Setting sparse to true allows the solver to take advantage
-  // of sparse routines, this makes the computation MUCH FASTER. If you
-  // can uncomment 1 of these and see if it makes a difference or not but
-  // if you uncomment both the computation time should go up in orders of
-  // magnitude.
-  options += "Sparse  true        forward\n";
-  options += "Sparse  true        reverse\n";
-  // NOTE: Currently the solver has a maximum time limit of 0.5 seconds.
-  // Change this as you see fit.
-  options += "Numeric max_cpu_time          0.5\n";
+  std::string options = ipopt_options(config.max_cpu_time);
 
   // place to return solution
   CppAD::ipopt::solve_result<Dvector> solution;
+  last_timings.setup += lap(mark);
 
   // solve the problem
-  CppAD::ipopt::solve<Dvector, FG_eval>(
+  CppAD::ipopt::solve<Dvector, FG_eval<Eigen::VectorXd>>(
       options, vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
       constraints_upperbound, fg_eval, solution);
+  last_timings.optimize = lap(mark);
 
   // Check some of the solution values
   bool ok = solution.status == CppAD::ipopt::solve_result<Dvector>::success;
   if (! ok) {
     std::cerr << "WARNING: solver was not successful" << std::endl;
+    warm_start.clear();
+    has_kkt = false;
+  } else {
+    warm_start.resize(layout.n_vars);
+    for (unsigned int i = 0; i < layout.n_vars; i++) {
+      warm_start[i] = solution.x[i];
+    }
+
+    if (sensitivity_max_change > 0) {
+      // A bound is active if the solution is within a small fraction of the range from it,
+      // or past it, as IPOPT relaxes the bounds slightly: -1 at a lower bound, 1 at an
+      // upper one, else 0.
+      vector<int> at_bound(layout.n_vars);
+      vector<double> bound_multipliers(layout.n_vars);
+      for (unsigned int i = 0; i < layout.n_vars; i++) {
+        double margin = 1e-4 * (vars_upperbound[i] - vars_lowerbound[i]);
+        if (solution.x[i] - vars_lowerbound[i] < margin) {
+          at_bound[i] = -1;
+        } else if (vars_upperbound[i] - solution.x[i] < margin) {
+          at_bound[i] = 1;
+        }
+        bound_multipliers[i] = solution.zl[i] - solution.zu[i];
+      }
+      vector<double> lambda(layout.n_constraints);
+      for (unsigned int c = 0; c < layout.n_constraints; c++) {
+        lambda[c] = solution.lambda[c];
+      }
+      FormKKT(params, warm_start, lambda, bound_multipliers, at_bound);
+      cycles_since_full_solve = 0;
+    }
   }
 
   // Cost
   // std::cout << "Cost " << solution.obj_value << std::endl;
 
-  double next_delta = solution.x[delta_start];
-  double next_a = solution.x[a_start];
+  double next_delta = solution.x[layout.delta_start];
+  double next_a = solution.x[layout.a_start];
   
   // For solved x and y, include the current timestep.
-  vector<double> solved_x(solver_N), solved_y(solver_N);
-  for (unsigned int i = 0; i < solver_N; i++) {
-    solved_x[i] = solution.x[x_start + i];
-    solved_y[i] = solution.x[y_start + i];
+  vector<double> solved_x(config.N), solved_y(config.N);
+  for (unsigned int i = 0; i < config.N; i++) {
+    solved_x[i] = solution.x[layout.x_start + i];
+    solved_y[i] = solution.x[layout.y_start + i];
   }
+  last_timings.extract = lap(mark);
 
   return std::make_tuple(next_delta, next_a, solved_x, solved_y);
 }
+
+//
+// Frenet formulation.
+//
+
+// The layout of the variables, as for the Cartesian formulation, with four states.
+struct FrenetLayout {
+  explicit FrenetLayout(size_t N) :
+    s_start(0),
+    n_start(s_start + N),
+    mu_start(n_start + N),
+    v_start(mu_start + N),
+    delta_start(v_start + N),
+    a_start(delta_start + N - 1),
+    n_vars(a_start + N - 1),
+    n_constraints(delta_start) {}
+
+  const size_t s_start;
+  const size_t n_start;
+  const size_t mu_start;
+  const size_t v_start;
+  const size_t delta_start;
+  const size_t a_start;
+  const size_t n_vars;
+  const size_t n_constraints;
+};
+
+// The cubic through `p1` at `u` = 0 and `p2` at `u` = 1, with the slopes of the chords
+// from `p0` and to `p3`, of Catmull-Rom interpolation.
+template <class Scalar>
+Scalar catmull_rom(const Scalar & u, const Scalar & p0, const Scalar & p1, const Scalar & p2,
+                   const Scalar & p3) {
+  return 0.5 * (2 * p1 + u * ((p2 - p0) + u * ((2 * p0 - 5 * p1 + 4 * p2 - p3) +
+                                                u * (3 * (p1 - p2) + p3 - p0))));
+}
+
+// Curvature at arc length `s`, by Catmull-Rom interpolation of the 4 samples around it,
+// which, unlike linear interpolation, is C1 in `s`, as the solver needs. Beyond the
+// profile, its end segments are extrapolated. The profile must have at least 4 samples.
+double profile_curvature(const CurvatureProfile & profile, double s) {
+  const vector<double> & kappa = profile.curvature;
+  double z = s / profile.spacing;
+  double i = std::max(1.0, std::min((double) (kappa.size() - 3), floor(z)));
+  size_t k = i;
+  return catmull_rom(z - i, kappa[k - 1], kappa[k], kappa[k + 1], kappa[k + 2]);
+}
+
+// As `profile_curvature`, on the tape. The tape is recorded once per solve, so the samples
+// around `s` are looked up in `VecAD` tables as it is evaluated, rather than chosen as it
+// is recorded.
+class CurvatureTable {
+ public:
+  explicit CurvatureTable(const CurvatureProfile & profile) :
+    spacing(profile.spacing),
+    last_i(profile.curvature.size() - 3),
+    kappa(profile.curvature.size()),
+    index(profile.curvature.size()) {
+    for (size_t j = 0; j < profile.curvature.size(); j++) {
+      kappa[j] = profile.curvature[j];
+      index[j] = j;
+    }
+  }
+
+  AD<double> At(const AD<double> & s) {
+    AD<double> z = s / spacing;
+    AD<double> clamped = CppAD::CondExpLt(z, AD<double>(1), AD<double>(1), z);
+    clamped = CppAD::CondExpGt(clamped, AD<double>(last_i), AD<double>(last_i), clamped);
+    // Truncates `clamped`, i.e. its floor.
+    AD<double> i = index[clamped];
+    return catmull_rom<AD<double>>(z - i, kappa[i - 1], kappa[i], kappa[i + 1], kappa[i + 2]);
+  }
+
+ private:
+  double spacing;
+  double last_i;
+  CppAD::VecAD<double> kappa;
+  CppAD::VecAD<double> index;
+};
+
+class FrenetFG_eval {
+ public:
+  // Horizon and cost weights
+  const MPCConfig & config;
+  const FrenetLayout layout;
+
+  // Track curvature ahead
+  const CurvatureProfile & curvature;
+
+  // Target speed at each timestep
+  const Eigen::VectorXd & speed_reference;
+
+  FrenetFG_eval(const MPCConfig & config_, const CurvatureProfile & curvature_,
+                const Eigen::VectorXd & speed_reference_) :
+    config(config_),
+    layout(config_.N),
+    curvature(curvature_),
+    speed_reference(speed_reference_) {}
+
+  typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
+
+  // See `FG_eval`.
+  void operator()(ADvector& fg, const ADvector& vars) {
+    fg[0] = 0;
+
+    // The same costs as `FG_eval`, the lateral offset and heading error standing for
+    // cte and epsi.
+    for (unsigned int t = 0; t < config.N; t++) {
+      fg[0] += config.cte_weight * (config.N - t) * CppAD::pow(vars[layout.n_start + t] / std_cte, 2);
+      fg[0] += config.epsi_weight * CppAD::pow(vars[layout.mu_start + t] / std_epsi, 2);
+      fg[0] += config.speed_weight *
+        CppAD::pow((vars[layout.v_start + t] - speed_reference[t]) / speed_limit, 2);
+    }
+    for (unsigned int t = 0; t < config.N - 1; t++) {
+      fg[0] += config.steering_weight * CppAD::pow(vars[layout.delta_start + t] / max_delta, 2);
+      fg[0] += config.acceleration_weight * CppAD::pow(vars[layout.a_start + t] / max_acc, 2);
+    }
+    for (unsigned int t = 0; t < config.N - 2; t++) {
+      fg[0] += config.steering_change_weight * CppAD::pow(
+        (vars[layout.delta_start + t + 1] - vars[layout.delta_start + t]) / std_ddelta_dt, 2);
+      fg[0] += config.acceleration_change_weight * CppAD::pow(
+        (vars[layout.a_start + t + 1] - vars[layout.a_start + t]) / std_dacc_dt, 2);
+    }
+
+    CurvatureTable curvature_table(curvature);
+
+    fg[1 + layout.s_start] = vars[layout.s_start];
+    fg[1 + layout.n_start] = vars[layout.n_start];
+    fg[1 + layout.mu_start] = vars[layout.mu_start];
+    fg[1 + layout.v_start] = vars[layout.v_start];
+
+    for (unsigned int t = 1; t < config.N; t++) {
+      AD<double> s1 = vars[layout.s_start + t];
+      AD<double> n1 = vars[layout.n_start + t];
+      AD<double> mu1 = vars[layout.mu_start + t];
+      AD<double> v1 = vars[layout.v_start + t];
+
+      AD<double> s0 = vars[layout.s_start + t - 1];
+      AD<double> n0 = vars[layout.n_start + t - 1];
+      AD<double> mu0 = vars[layout.mu_start + t - 1];
+      AD<double> v0 = vars[layout.v_start + t - 1];
+
+      AD<double> delta0 = vars[layout.delta_start + t - 1];
+      AD<double> a0 = vars[layout.a_start + t - 1];
+
+      AD<double> kappa0 = curvature_table.At(s0);
+      AD<double> s_dot = v0 * CppAD::cos(mu0) / (1 - n0 * kappa0);
+
+      fg[1 + layout.s_start + t] = s1 - (s0 + s_dot * config.dt);
+      fg[1 + layout.n_start + t] = n1 - (n0 + v0 * CppAD::sin(mu0) * config.dt);
+      fg[1 + layout.mu_start + t] = mu1 - (mu0 + (yaw_rate(v0, delta0) - kappa0 * s_dot) * config.dt);
+      fg[1 + layout.v_start + t] = v1 - (v0 + a0 * config.dt);
+    }
+  }
+};
+
+FrenetMPC::FrenetMPC(const MPCConfig & config) : config(config), last_timings() {}
+FrenetMPC::~FrenetMPC() {}
+
+double FrenetMPC::Lookahead() const {
+  return speed_limit * (config.N - 1) * config.dt;
+}
+
+bool FrenetMPC::ActuationProfile(vector<double> & steering, vector<double> & acceleration) const {
+  const FrenetLayout layout(config.N);
+  if (warm_start.size() != layout.n_vars) {
+    return false;
+  }
+  steering.assign(warm_start.begin() + layout.delta_start, warm_start.begin() + layout.a_start);
+  acceleration.assign(warm_start.begin() + layout.a_start, warm_start.begin() + layout.n_vars);
+  return true;
+}
+
+// As `MPC::Solve`, except that even without a previous solution, the states are rolled
+// out, with zero actuations, so that the solver starts on a feasible trajectory.
+std::tuple<double, double, vector<double>, vector<double>>
+FrenetMPC::Solve(const vector<double> & init_state, const CurvatureProfile & curvature,
+                 const Eigen::VectorXd & speed_reference, bool shift_warm_start) {
+
+  typedef CPPAD_TESTVECTOR(double) Dvector;
+
+  auto mark = std::chrono::steady_clock::now();
+  last_timings = SolveTimings();
+
+  const FrenetLayout layout(config.N);
+
+  Dvector vars(layout.n_vars);
+  for (unsigned int i = 0; i < layout.n_vars; i++) {
+    vars[i] = 0.0;
+  }
+
+  Dvector vars_lowerbound(layout.n_vars);
+  Dvector vars_upperbound(layout.n_vars);
+  for (unsigned int i = 0; i < layout.delta_start; i++) {
+    vars_lowerbound[i] = -1.0e19;
+    vars_upperbound[i] = 1.0e19;
+  }
+  for (unsigned int i = layout.v_start; i < layout.delta_start; i++) {
+    vars_lowerbound[i] = -speed_limit;
+    vars_upperbound[i] = speed_limit;
+  }
+  for (unsigned int i = layout.delta_start; i < layout.a_start; i++) {
+    vars_lowerbound[i] = -max_delta;
+    vars_upperbound[i] = max_delta;
+  }
+  for (unsigned int i = layout.a_start; i < layout.n_vars; i++) {
+    vars_lowerbound[i] = -max_acc;
+    vars_upperbound[i] = max_acc;
+  }
+
+  Dvector constraints_lowerbound(layout.n_constraints);
+  Dvector constraints_upperbound(layout.n_constraints);
+  for (unsigned int i = 0; i < layout.n_constraints; i++) {
+    constraints_lowerbound[i] = constraints_upperbound[i] = 0.0;
+  }
+
+  vars[layout.s_start] = constraints_lowerbound[layout.s_start] =
+    constraints_upperbound[layout.s_start] = init_state[0];
+  vars[layout.n_start] = constraints_lowerbound[layout.n_start] =
+    constraints_upperbound[layout.n_start] = init_state[1];
+  vars[layout.mu_start] = constraints_lowerbound[layout.mu_start] =
+    constraints_upperbound[layout.mu_start] = init_state[2];
+  vars[layout.v_start] = constraints_lowerbound[layout.v_start] =
+    constraints_upperbound[layout.v_start] = init_state[3];
+
+  if (warm_start.size() == layout.n_vars) {
+    for (unsigned int t = 0; t < config.N - 1; t++) {
+      unsigned int prev_t = shift_warm_start ? std::min(t + 1, (unsigned int) config.N - 2) : t;
+      vars[layout.delta_start + t] = warm_start[layout.delta_start + prev_t];
+      vars[layout.a_start + t] = warm_start[layout.a_start + prev_t];
+    }
+  }
+  for (unsigned int t = 1; t < config.N; t++) {
+    double s0 = vars[layout.s_start + t - 1];
+    double n0 = vars[layout.n_start + t - 1];
+    double mu0 = vars[layout.mu_start + t - 1];
+    double v0 = vars[layout.v_start + t - 1];
+    double delta0 = vars[layout.delta_start + t - 1];
+    double a0 = vars[layout.a_start + t - 1];
+
+    double kappa0 = profile_curvature(curvature, s0);
+    double s_dot = v0 * cos(mu0) / (1 - n0 * kappa0);
+
+    vars[layout.s_start + t] = s0 + s_dot * config.dt;
+    vars[layout.n_start + t] = n0 + v0 * sin(mu0) * config.dt;
+    vars[layout.mu_start + t] = mu0 + (yaw_rate(v0, delta0) - kappa0 * s_dot) * config.dt;
+    vars[layout.v_start + t] = std::max(-speed_limit, std::min(speed_limit, v0 + a0 * config.dt));
+  }
+
+  Eigen::VectorXd v_ref = speed_reference.size() == (int) config.N ?
+    speed_reference : Eigen::VectorXd::Constant(config.N, speed_limit);
+  FrenetFG_eval fg_eval(config, curvature, v_ref);
+
+  std::string options = ipopt_options(config.max_cpu_time);
+
+  CppAD::ipopt::solve_result<Dvector> solution;
+  last_timings.setup = lap(mark);
+
+  CppAD::ipopt::solve<Dvector, FrenetFG_eval>(
+      options, vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
+      constraints_upperbound, fg_eval, solution);
+  last_timings.optimize = lap(mark);
+
+  bool ok = solution.status == CppAD::ipopt::solve_result<Dvector>::success;
+  if (! ok) {
+    std::cerr << "WARNING: solver was not successful" << std::endl;
+    warm_start.clear();
+  } else {
+    warm_start.resize(layout.n_vars);
+    for (unsigned int i = 0; i < layout.n_vars; i++) {
+      warm_start[i] = solution.x[i];
+    }
+  }
+
+  vector<double> solved_s(config.N), solved_n(config.N);
+  for (unsigned int i = 0; i < config.N; i++) {
+    solved_s[i] = solution.x[layout.s_start + i];
+    solved_n[i] = solution.x[layout.n_start + i];
+  }
+  last_timings.extract = lap(mark);
+
+  return std::make_tuple(solution.x[layout.delta_start], solution.x[layout.a_start],
+                         solved_s, solved_n);
+}
@@ -2,21 +2,62 @@
 #define MPC_H
 
 #include <list>
+#include <string>
 #include <tuple>
 #include <vector>
 #include "Eigen-3.3/Eigen/Core"
-
-extern const double Lf;
+#include "Eigen-3.3/Eigen/LU"
+#include "vehicle_model.h"
 
 const double mps_to_mph = 2.236936; // 1 meter/sec equals this much mile/hour
 
+// The horizon and the multipliers of the cost terms, which are tuned per track and
+// vehicle. Each cost term is squared after normalizing by its typical magnitude.
+struct MPCConfig {
+  size_t N = 12; // number of timesteps
+  double dt = 0.1; // duration of a timestep, in seconds
+
+  double cte_weight = 50; // times the number of timesteps left, to favor the proximal end
+  double epsi_weight = 2;
+  double speed_weight = 50; // deviation from the reference speed
+  double steering_weight = 5;
+  double acceleration_weight = 1;
+  double steering_change_weight = 50; // between consecutive timesteps
+  double acceleration_change_weight = 1;
+
+  double max_cpu_time = 0.5; // of one IPOPT solve, in seconds
+
+  // Set the field named `key`, e.g. "N" or "cte_weight". Return false if there is no such
+  // field, or the value is out of its range.
+  bool Set(const std::string & key, double value);
+
+  // Set fields from comma separated assignments, e.g. "N=10,dt=0.12,cte_weight=80".
+  bool Parse(const std::string & assignments);
+
+  // The names of the fields, in declaration order, and their values in the same order.
+  static const std::vector<std::string> & Keys();
+  std::vector<double> Values() const;
+};
+
+// Where the wall time of the last `Solve` went, in seconds.
+struct SolveTimings {
+  double setup; // of the bounds, the warm start and the objective
+  // In IPOPT, including CppAD's taping of the objective and constraints, which it redoes
+  // on each solve; or in the sensitivity update that replaced it.
+  double optimize;
+  double extract; // of the solution, and of the warm start and KKT system for the next solve
+};
+
 class MPC {
  public:
-  MPC();
+  explicit MPC(const MPCConfig & config = MPCConfig());
 
   virtual ~MPC();
 
   // Solve the model given an initial state and polynomial coefficients.
+  // `speed_reference` is the target speed at each timestep, or if empty, the speed limit.
+  // Unless `shift_warm_start` is false, the previous solution is assumed to be one
+  // timestep older than this one, and is shifted accordingly to warm start the solver.
   // Return tuple with (
   //   optimal next steering actuation,
   //   optimal next acceleration actuation,
@@ -24,7 +65,121 @@ class MPC {
   //   y values of the optimal simulated trajectory
   // )
   std::tuple<double, double, std::vector<double>, std::vector<double>>
-  Solve(const std::vector<double> & init_state, const Eigen::VectorXd & coeffs);
+  Solve(const std::vector<double> & init_state, const Eigen::VectorXd & coeffs,
+        const Eigen::VectorXd & speed_reference, bool shift_warm_start = true);
+
+  // Between full solves, predict the solution from the last full solve, by the first
+  // order sensitivity of the optimum to the initial state, speed reference and
+  // coefficients, instead of running IPOPT. A full solve still runs every
+  // `full_solve_interval` calls, and whenever the predicted change of any actuation
+  // exceeds `max_change`, as a fraction of its range, or a bound becomes active, or
+  // inactive by the sign of its predicted multiplier.
+  void EnableSensitivityUpdates(double max_change, unsigned int full_solve_interval);
+
+  // The optimal steering and acceleration actuations of the last solution, one per
+  // timestep of the horizon. Return false if the last solve failed.
+  bool ActuationProfile(std::vector<double> & steering, std::vector<double> & acceleration) const;
+
+  // The duration of a timestep, in seconds, and the number of timesteps.
+  double timestep() const { return config.dt; }
+  size_t horizon() const { return config.N; }
+
+  const SolveTimings & timings() const { return last_timings; }
+
+  // Prepare CppAD for MPC instances solving concurrently on up to `max_threads` threads.
+  // Must be called once, from the main thread, before any of those threads start.
+  static void SetupThreads(size_t max_threads);
+
+  // Identify the calling thread to CppAD. `thread_num` must be in [1, max_threads]
+  // and unique among the threads running concurrently. The main thread is 0.
+  static void SetThreadNumber(size_t thread_num);
+
+ private:
+  // Form and factorize the KKT system at the optimum `x`, with constraint multipliers
+  // `lambda` and bound multipliers `bound_multipliers` (z_L - z_U), of the problem given
+  // by `params`, i.e. the initial state, speed reference and coefficients. `at_bound` is
+  // -1 for a variable held at its lower bound, 1 at its upper one, else 0.
+  void FormKKT(const Eigen::VectorXd & params, const std::vector<double> & x,
+               const std::vector<double> & lambda, const std::vector<double> & bound_multipliers,
+               const std::vector<int> & at_bound);
+
+  // The tangential predictor step from the factorized optimum to `params`, and the
+  // predicted bound multipliers of the variables held at a bound.
+  Eigen::VectorXd PredictChange(const Eigen::VectorXd & params,
+                                Eigen::VectorXd & pinned_multipliers) const;
+
+  MPCConfig config;
+
+  // The previous solution, used as the starting point of the next solve.
+  std::vector<double> warm_start;
+
+  SolveTimings last_timings;
+
+  double sensitivity_max_change; // 0 if sensitivity updates are disabled
+  unsigned int full_solve_interval;
+  unsigned int cycles_since_full_solve;
+
+  // The KKT system of the last full solve.
+  bool has_kkt;
+  Eigen::VectorXd kkt_params;
+  Eigen::VectorXd kkt_solution;
+  std::vector<size_t> kkt_free; // the variables not at a bound, in the order of the system
+  Eigen::PartialPivLU<Eigen::MatrixXd> kkt_lu;
+  Eigen::MatrixXd kkt_dparams; // the derivative of the KKT conditions by the parameters
+  // The variables held at a bound, which side, as for `FormKKT`, their bound multipliers,
+  // and the derivatives of those by the solution of the system and by the parameters.
+  std::vector<size_t> kkt_pinned;
+  std::vector<int> kkt_pinned_side;
+  Eigen::VectorXd kkt_pinned_multipliers;
+  Eigen::MatrixXd kkt_pinned_dz;
+  Eigen::MatrixXd kkt_pinned_dparams;
+};
+
+// Track curvature ahead of the vehicle: `curvature[j]` is at arc length `j * spacing`
+// ahead of the projection of the initial state onto the track.
+struct CurvatureProfile {
+  double spacing; // meter
+  std::vector<double> curvature; // 1/meter, positive when turning left
+};
+
+// The same MPC, formulated in the Frenet frame of a track map instead of the car's
+// Cartesian frame. The state is the arc length `s` along the centerline, the lateral
+// offset `n` from it (positive to the left), the heading error `mu` with respect to it,
+// and the speed `v`. The curvature of the centerline is looked up from a table over
+// arc length, by Catmull-Rom interpolation, instead of from a polynomial fitted to waypoints.
+class FrenetMPC {
+ public:
+  explicit FrenetMPC(const MPCConfig & config = MPCConfig());
+
+  virtual ~FrenetMPC();
+
+  // Solve the model given an initial state (s, n, mu, v), where s is 0, and the curvature
+  // ahead, which must span `Lookahead()`. See `MPC::Solve` for the other arguments.
+  // Return tuple with (
+  //   optimal next steering actuation,
+  //   optimal next acceleration actuation,
+  //   s values of the optimal simulated trajectory,
+  //   n values of the optimal simulated trajectory
+  // )
+  std::tuple<double, double, std::vector<double>, std::vector<double>>
+  Solve(const std::vector<double> & init_state, const CurvatureProfile & curvature,
+        const Eigen::VectorXd & speed_reference, bool shift_warm_start = true);
+
+  // See `MPC::ActuationProfile`.
+  bool ActuationProfile(std::vector<double> & steering, std::vector<double> & acceleration) const;
+
+  // The arc length the vehicle can cover over the horizon at the speed limit, in meters.
+  double Lookahead() const;
+
+  const SolveTimings & timings() const { return last_timings; }
+
+ private:
+  MPCConfig config;
+
+  // The previous solution, used as the starting point of the next solve.
+  std::vector<double> warm_start;
+
+  SolveTimings last_timings;
 };
 
 #endif /* MPC_H */
@@ -0,0 +1,53 @@
+#ifndef ACTUATION_HISTORY_H
+#define ACTUATION_HISTORY_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+
+// An actuation command, and when it was sent.
+struct PastActuation {
+  double steering;
+  double throttle;
+  std::chrono::steady_clock::time_point time;
+};
+
+// The most recent actuations, newest first, in a fixed-capacity ring.
+// Pushing and truncating are O(1) and never allocate.
+class ActuationHistory {
+ public:
+  static const size_t capacity = 64;
+
+  ActuationHistory() : newest_(0), size_(0) {}
+
+  // Add the newest actuation. If full, the oldest one is dropped.
+  void Push(const PastActuation & actuation) {
+    newest_ = (newest_ + capacity - 1) % capacity;
+    ring_[newest_] = actuation;
+    if (size_ < capacity) {
+      size_++;
+    }
+  }
+
+  // Keep only the `n` newest actuations.
+  void Truncate(size_t n) {
+    if (n < size_) {
+      size_ = n;
+    }
+  }
+
+  // The `i`-th newest actuation. 0 is the newest.
+  const PastActuation & operator[](size_t i) const {
+    return ring_[(newest_ + i) % capacity];
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+ private:
+  std::array<PastActuation, capacity> ring_;
+  size_t newest_;
+  size_t size_;
+};
+
+#endif /* ACTUATION_HISTORY_H */
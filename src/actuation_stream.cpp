@@ -0,0 +1,78 @@
+#include "actuation_stream.h"
+#include <math.h>
+#include <algorithm>
+
+void interpolate_profile(const ActuationProfile & profile, ActuationStreamer::clock::time_point time,
+                         double & steering, double & throttle) {
+  size_t n = std::min(profile.steering.size(), profile.throttle.size());
+  double steps = std::chrono::duration<double>(time - profile.start).count() / profile.dt;
+  if (steps <= 0) {
+    steering = profile.steering[0];
+    throttle = profile.throttle[0];
+    return;
+  }
+  size_t i = (size_t) floor(steps);
+  if (i + 1 >= n) {
+    steering = profile.steering[n - 1];
+    throttle = profile.throttle[n - 1];
+    return;
+  }
+  double frac = steps - i;
+  steering = profile.steering[i] + (profile.steering[i + 1] - profile.steering[i]) * frac;
+  throttle = profile.throttle[i] + (profile.throttle[i + 1] - profile.throttle[i]) * frac;
+}
+
+ActuationStreamer::ActuationStreamer(double rate_hz, Sink sink) :
+  period(std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1 / rate_hz))),
+  sink(sink),
+  has_profile(false),
+  stopping(false) {
+  thread = std::thread(&ActuationStreamer::Run, this);
+}
+
+ActuationStreamer::~ActuationStreamer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  stop_cv.notify_all();
+  thread.join();
+}
+
+void ActuationStreamer::Publish(ActuationProfile profile) {
+  if (profile.steering.empty() || profile.throttle.empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  this->profile = std::move(profile);
+  has_profile = true;
+}
+
+void ActuationStreamer::Run() {
+  auto tick = clock::now();
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    // Tick at fixed times rather than fixed intervals, so that the rate does not drift.
+    // If a tick is overdue by more than a period, skip it rather than burst.
+    tick += period;
+    auto now = clock::now();
+    if (tick < now) {
+      tick = now;
+    }
+    if (stop_cv.wait_until(lock, tick, [this]() { return stopping; })) {
+      return;
+    }
+    if (!has_profile) {
+      continue;
+    }
+
+    double steering, throttle;
+    interpolate_profile(profile, tick, steering, throttle);
+    uint64_t seq = profile.seq;
+
+    // Do not hold the lock while the sink runs, so that publishing never waits on it.
+    lock.unlock();
+    sink(seq, tick, steering, throttle);
+    lock.lock();
+  }
+}
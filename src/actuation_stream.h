@@ -0,0 +1,63 @@
+#ifndef ACTUATION_STREAM_H
+#define ACTUATION_STREAM_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The optimal actuations of one solve over the MPC horizon.
+// `steering[i]` and `throttle[i]` are due at `start + i * dt`.
+struct ActuationProfile {
+  uint64_t seq; // of the telemetry solved
+  std::chrono::steady_clock::time_point start;
+  double dt; // second
+  std::vector<double> steering;
+  std::vector<double> throttle;
+};
+
+// Publishes actuations at a fixed rate, higher than the solve rate, by interpolating
+// the newest profile linearly at each tick. Before the profile starts, its first
+// actuation is held, and after it ends, its last.
+//
+// For actuators that accept commands at any time. The simulator does not.
+class ActuationStreamer {
+ public:
+  typedef std::chrono::steady_clock clock;
+
+  // Called on the streamer thread at each tick.
+  typedef std::function<void(uint64_t seq, clock::time_point time,
+                             double steering, double throttle)> Sink;
+
+  ActuationStreamer(double rate_hz, Sink sink);
+
+  // Stop ticking, and join the streamer thread.
+  virtual ~ActuationStreamer();
+
+  // Replace the profile being streamed. May be called from any thread.
+  void Publish(ActuationProfile profile);
+
+ private:
+  void Run();
+
+  clock::duration period;
+  Sink sink;
+
+  // Guards `profile`, `has_profile` and `stopping`.
+  std::mutex mutex;
+  std::condition_variable stop_cv;
+  ActuationProfile profile;
+  bool has_profile;
+  bool stopping;
+
+  std::thread thread;
+};
+
+// Interpolate the profile at `time`. The profile must not be empty.
+void interpolate_profile(const ActuationProfile & profile, ActuationStreamer::clock::time_point time,
+                         double & steering, double & throttle);
+
+#endif /* ACTUATION_STREAM_H */
@@ -0,0 +1,89 @@
+#include "affine.h"
+#include <math.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define AFFINE_HAS_AVX2_KERNEL
+#include <immintrin.h>
+#endif
+
+// With the translation folded into the rotation, each coordinate is two fused multiply-adds:
+//   x' = cos x - sin y + (cos offset_x - sin offset_y)
+//   y' = sin x + cos y + (sin offset_x + cos offset_y)
+struct AffineCoefficients {
+  double c;
+  double s;
+  double tx;
+  double ty;
+
+  AffineCoefficients(double offset_x, double offset_y, double angle) :
+    c(cos(angle)),
+    s(sin(angle)),
+    tx(c * offset_x - s * offset_y),
+    ty(s * offset_x + c * offset_y) {}
+};
+
+// Without FMA in the compiler flags, `fma()` would be a library call, so this leaves
+// contraction to the compiler.
+static void transform_scalar(const AffineCoefficients & a, const double *xs, const double *ys,
+                             size_t begin, size_t end, double *out_x, double *out_y) {
+  for (size_t i = begin; i < end; i++) {
+    double x = xs[i];
+    double y = ys[i];
+    out_x[i] = a.c * x - a.s * y + a.tx;
+    out_y[i] = a.s * x + a.c * y + a.ty;
+  }
+}
+
+void translate_then_rotate_scalar(const double *xs, const double *ys, size_t n,
+                                  double offset_x, double offset_y, double angle,
+                                  double *out_x, double *out_y) {
+  transform_scalar(AffineCoefficients(offset_x, offset_y, angle), xs, ys, 0, n, out_x, out_y);
+}
+
+#ifdef AFFINE_HAS_AVX2_KERNEL
+
+// Four points per iteration, and the remainder in scalar code.
+__attribute__((target("avx2,fma")))
+static void transform_avx2(const AffineCoefficients & a, const double *xs, const double *ys,
+                           size_t n, double *out_x, double *out_y) {
+  __m256d c = _mm256_set1_pd(a.c);
+  __m256d s = _mm256_set1_pd(a.s);
+  __m256d minus_s = _mm256_set1_pd(-a.s);
+  __m256d tx = _mm256_set1_pd(a.tx);
+  __m256d ty = _mm256_set1_pd(a.ty);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d x = _mm256_loadu_pd(xs + i);
+    __m256d y = _mm256_loadu_pd(ys + i);
+    __m256d rotated_x = _mm256_fmadd_pd(c, x, _mm256_fmadd_pd(minus_s, y, tx));
+    __m256d rotated_y = _mm256_fmadd_pd(s, x, _mm256_fmadd_pd(c, y, ty));
+    _mm256_storeu_pd(out_x + i, rotated_x);
+    _mm256_storeu_pd(out_y + i, rotated_y);
+  }
+  // GCC does not clear the upper halves of the registers on leaving a function that is
+  // only AVX by its target attribute, and the SSE code after it, e.g. `sin` and `cos` of
+  // the next call, would then pay for the transition.
+  _mm256_zeroupper();
+  transform_scalar(a, xs, ys, i, n, out_x, out_y);
+}
+
+static bool has_avx2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+#endif
+
+void translate_then_rotate(const double *xs, const double *ys, size_t n,
+                           double offset_x, double offset_y, double angle,
+                           double *out_x, double *out_y) {
+  AffineCoefficients a(offset_x, offset_y, angle);
+#ifdef AFFINE_HAS_AVX2_KERNEL
+  static const bool avx2 = has_avx2();
+  if (avx2) {
+    transform_avx2(a, xs, ys, n, out_x, out_y);
+    return;
+  }
+#endif
+  transform_scalar(a, xs, ys, 0, n, out_x, out_y);
+}
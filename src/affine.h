@@ -0,0 +1,22 @@
+#ifndef AFFINE_H
+#define AFFINE_H
+
+#include <cstddef>
+
+// Transform `n` points to another coordinate system: translate them by (offset_x, offset_y),
+// then rotate them by `angle`. E.g. with the negated pose of a car, from the global
+// coordinate system to the car's.
+//
+// The points are in structure-of-arrays layout. The outputs may be the inputs, to transform
+// in place, but must not otherwise overlap them. Uses AVX2 and FMA if the CPU has them,
+// whatever the compiler flags.
+void translate_then_rotate(const double *xs, const double *ys, size_t n,
+                           double offset_x, double offset_y, double angle,
+                           double *out_x, double *out_y);
+
+// The same, without SIMD, e.g. to compare with.
+void translate_then_rotate_scalar(const double *xs, const double *ys, size_t n,
+                                  double offset_x, double offset_y, double angle,
+                                  double *out_x, double *out_y);
+
+#endif /* AFFINE_H */
@@ -0,0 +1,32 @@
+// Usage: ./bench [name ...]
+// Run the named benchmarks, or all of them if none is named.
+
+#include <cstring>
+#include <iostream>
+#include "bench.h"
+
+struct Benchmark {
+  const char *name;
+  void (*run)();
+};
+
+static const Benchmark benchmarks[] = {
+  {"affine", bench_affine},
+  {"model", bench_model},
+  {"polyfit", bench_polyfit},
+  {"track", bench_track},
+  {"wire", bench_wire},
+};
+
+int main(int argc, char* argv[]) {
+  for (const auto & benchmark : benchmarks) {
+    bool selected = argc < 2;
+    for (int i = 1; i < argc; i++) {
+      selected |= strcmp(argv[i], benchmark.name) == 0;
+    }
+    if (selected) {
+      std::cout << benchmark.name << std::endl;
+      benchmark.run();
+    }
+  }
+}
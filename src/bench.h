@@ -0,0 +1,44 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+// Micro benchmarks, run by the `bench` executable.
+
+// Run `op` repeatedly for about `min_seconds`, and return the mean nanoseconds per call.
+template <class Op>
+double bench_ns_per_op(Op op, double min_seconds = 0.2) {
+  typedef std::chrono::steady_clock clock;
+  size_t iterations = 1;
+  while (true) {
+    auto start = clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+      op();
+    }
+    double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    if (elapsed >= min_seconds) {
+      return elapsed * 1e9 / iterations;
+    }
+    iterations *= 2;
+  }
+}
+
+inline void bench_report(const std::string & label, double ns_per_op) {
+  std::cout << "  " << label << ": " << ns_per_op << " ns" << std::endl;
+}
+
+// Keep the compiler from optimizing away a computed value.
+template <class T>
+inline void bench_keep(const T & value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+void bench_affine();
+void bench_model();
+void bench_polyfit();
+void bench_track();
+void bench_wire();
+
+#endif /* BENCH_H */
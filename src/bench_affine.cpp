@@ -0,0 +1,49 @@
+#include <math.h>
+#include <iostream>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "affine.h"
+#include "bench.h"
+
+using std::vector;
+
+// Transforming points into the car's coordinate system: the Eigen expression the
+// controller used, the scalar kernel and the SIMD kernel, at 10, 1k and 1M points.
+void bench_affine() {
+  const double px = -40.62008, py = 108.7301, psi = 3.733651;
+
+  for (size_t n : {10, 1000, 1000000}) {
+    vector<double> xs(n), ys(n), out_x(n), out_y(n);
+    for (size_t i = 0; i < n; i++) {
+      xs[i] = -32.16173 - 0.01 * i;
+      ys[i] = 113.361 - 0.007 * i;
+    }
+    std::cout << "  " << n << " points" << std::endl;
+
+    auto report = [n](const char *label, double ns_per_op) {
+      std::cout << "  " << label << ": " << ns_per_op << " ns, "
+        << n / ns_per_op << " points/ns" << std::endl;
+    };
+    report("eigen", bench_ns_per_op([&]() {
+      Eigen::MatrixXd translated(2, n);
+      translated.row(0) = Eigen::Map<Eigen::VectorXd>(xs.data(), n) +
+        Eigen::VectorXd::Ones(n) * -px;
+      translated.row(1) = Eigen::Map<Eigen::VectorXd>(ys.data(), n) +
+        Eigen::VectorXd::Ones(n) * -py;
+      Eigen::MatrixXd rotator(2, 2);
+      rotator << cos(-psi), -sin(-psi),
+                 sin(-psi), cos(-psi);
+      Eigen::MatrixXd rotated = rotator * translated;
+      bench_keep(rotated);
+    }));
+    report("scalar", bench_ns_per_op([&]() {
+      translate_then_rotate_scalar(xs.data(), ys.data(), n, -px, -py, -psi,
+                                   out_x.data(), out_y.data());
+      bench_keep(out_x);
+    }));
+    report("simd", bench_ns_per_op([&]() {
+      translate_then_rotate(xs.data(), ys.data(), n, -px, -py, -psi, out_x.data(), out_y.data());
+      bench_keep(out_x);
+    }));
+  }
+}
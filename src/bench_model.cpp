@@ -0,0 +1,116 @@
+#include <math.h>
+#include <iostream>
+#include <vector>
+#include "bench.h"
+#include "rollout.h"
+#include "simd_pack.h"
+#include "tools.h"
+#include "vehicle_model.h"
+
+using std::vector;
+
+// One step of the vehicle model for a batch of vehicles, a vehicle at a time,
+// and four at a time with `Pack4d`. Then closed loop rollouts of many vehicles over
+// 5 seconds, with `global_kinetic_model` and with `RolloutEngine`.
+void bench_model() {
+  const size_t n = 4096;
+  const double dt = 0.1;
+  vector<double> x(n), y(n), psi(n), v(n), steering(n), acceleration(n);
+  for (size_t i = 0; i < n; i++) {
+    x[i] = i;
+    y[i] = -0.5 * i;
+    psi[i] = 0.001 * i;
+    v[i] = 10 + 0.01 * i;
+    steering[i] = 0.1 * sin(i);
+    acceleration[i] = 0.5 * cos(i);
+  }
+  vector<double> next_x(n), next_y(n), next_psi(n), next_v(n);
+
+  auto step_scalar = [&]() {
+    for (size_t i = 0; i < n; i++) {
+      VehicleState<double> next = step(VehicleState<double> {x[i], y[i], psi[i], v[i]},
+                                       VehicleInput<double> {steering[i], acceleration[i]}, dt);
+      next_x[i] = next.x;
+      next_y[i] = next.y;
+      next_psi[i] = next.psi;
+      next_v[i] = next.v;
+    }
+  };
+  auto step_pack = [&]() {
+    for (size_t i = 0; i < n; i += Pack4d::size) {
+      VehicleState<Pack4d> state {
+        Pack4d::Load(&x[i]), Pack4d::Load(&y[i]), Pack4d::Load(&psi[i]), Pack4d::Load(&v[i])};
+      VehicleInput<Pack4d> input {Pack4d::Load(&steering[i]), Pack4d::Load(&acceleration[i])};
+      VehicleState<Pack4d> next = step(state, input, Pack4d(dt));
+      next.x.Store(&next_x[i]);
+      next.y.Store(&next_y[i]);
+      next.psi.Store(&next_psi[i]);
+      next.v.Store(&next_v[i]);
+    }
+  };
+
+  step_scalar();
+  vector<double> expected_x = next_x;
+  step_pack();
+  double max_error = 0;
+  for (size_t i = 0; i < n; i++) {
+    max_error = std::max(max_error, fabs(next_x[i] - expected_x[i]));
+  }
+  std::cout << "  " << n << " vehicles, largest difference " << max_error << std::endl;
+
+  double scalar_ns = bench_ns_per_op(step_scalar);
+  double pack_ns = bench_ns_per_op(step_pack);
+  std::cout << "  double: " << n / scalar_ns * 1e3 << " million steps/s" << std::endl;
+  std::cout << "  Pack4d: " << n / pack_ns * 1e3 << " million steps/s" << std::endl;
+
+  // Steer back to heading 0 and hold 20 meter/sec.
+  const double max_steering = 0.436332;
+  auto policy = [max_steering](size_t step_index, RolloutTile & tile) {
+    for (size_t i = 0; i < tile.size; i++) {
+      tile.steering[i] = std::max(-max_steering, std::min(max_steering, -0.5 * tile.psi[i]));
+      tile.acceleration[i] = std::max(-1.0, std::min(1.0, 0.5 * (20 - tile.v[i])));
+    }
+  };
+  const size_t num_steps = 50;
+  for (size_t num_vehicles : {1000, 100000}) {
+    VehicleBatch batch;
+    auto reset = [&]() {
+      batch.Resize(num_vehicles);
+      for (size_t i = 0; i < num_vehicles; i++) {
+        batch.x[i] = 0;
+        batch.y[i] = 0;
+        batch.psi[i] = -1 + 2.0 * i / num_vehicles;
+        batch.v[i] = 30.0 * i / num_vehicles;
+      }
+    };
+    std::cout << "  " << num_vehicles << " vehicles, " << num_steps << " steps" << std::endl;
+
+    double vector_ns = bench_ns_per_op([&]() {
+      reset();
+      for (size_t i = 0; i < num_vehicles; i++) {
+        vector<double> state = {batch.x[i], batch.y[i], batch.psi[i], batch.v[i], 0, 0};
+        for (size_t step_i = 0; step_i < num_steps; step_i++) {
+          double steering = std::max(-max_steering, std::min(max_steering, -0.5 * state[2]));
+          double acceleration = std::max(-1.0, std::min(1.0, 0.5 * (20 - state[3])));
+          state = global_kinetic_model(state, steering, acceleration, dt);
+        }
+        batch.x[i] = state[0];
+      }
+      bench_keep(batch.x);
+    });
+    std::cout << "  global_kinetic_model: " << num_vehicles * num_steps / vector_ns * 1e3
+      << " million vehicle steps/s" << std::endl;
+
+    for (size_t num_threads : {(size_t) 1, (size_t) 0}) {
+      RolloutEngine engine(num_threads);
+      double engine_ns = bench_ns_per_op([&]() {
+        reset();
+        engine.Run(batch, num_steps, dt, policy);
+        bench_keep(batch.x);
+      });
+      std::cout << "  RolloutEngine, " << RolloutEngine::kernel_name() << ", "
+        << engine.num_threads() << " threads: " << num_vehicles * num_steps / engine_ns * 1e3
+        << " million vehicle steps/s" << std::endl;
+    }
+  }
+}
@@ -0,0 +1,107 @@
+#include <math.h>
+#include <iostream>
+#include <vector>
+#include "bench.h"
+#include "incremental_fit.h"
+#include "polyfit.h"
+
+using std::vector;
+
+// The QR fit of `polyfit` vs `fit_cubic`, on the waypoints of a typical telemetry event,
+// in the car's coordinate system, and on as many points as `fit_cubic` takes. Then the
+// incremental fit, as the window of waypoints slides by one, against refitting it, for
+// windows up to 512 waypoints.
+void bench_polyfit() {
+  const double ptsx[] = {-32.16173, -43.49173, -61.09, -78.29172, -93.05002, -107.7717};
+  const double ptsy[] = {113.361, 105.941, 92.88499, 78.73102, 65.34102, 50.57938};
+  const double px = -40.62008, py = 108.7301, psi = 3.733651;
+
+  vector<double> xs6, ys6;
+  for (int i = 0; i < 6; i++) {
+    double dx = ptsx[i] - px;
+    double dy = ptsy[i] - py;
+    xs6.push_back(dx * cos(-psi) - dy * sin(-psi));
+    ys6.push_back(dx * sin(-psi) + dy * cos(-psi));
+  }
+  vector<double> xs16, ys16;
+  for (int i = 0; i < cubic_fit_max_points; i++) {
+    xs16.push_back(-10 + 6.5 * i);
+    ys16.push_back(0.5 + 0.02 * xs16[i] - 0.003 * xs16[i] * xs16[i] + 1e-5 * pow(xs16[i], 3));
+  }
+
+  for (const auto & points : {std::make_pair(&xs6, &ys6), std::make_pair(&xs16, &ys16)}) {
+    const vector<double> & xs = *points.first;
+    const vector<double> & ys = *points.second;
+    Eigen::VectorXd xvals = Eigen::Map<const Eigen::VectorXd>(xs.data(), xs.size());
+    Eigen::VectorXd yvals = Eigen::Map<const Eigen::VectorXd>(ys.data(), ys.size());
+
+    Eigen::VectorXd reference = polyfit(xvals, yvals, 3);
+    Eigen::Vector4d coeffs;
+    fit_cubic(xs.data(), ys.data(), xs.size(), coeffs);
+    double max_error = 0;
+    for (int k = 0; k < 4; k++) {
+      max_error = std::max(max_error, fabs(coeffs[k] - reference[k]) / (fabs(reference[k]) + 1e-12));
+    }
+    std::cout << "  " << xs.size() << " points, largest relative difference " << max_error
+      << std::endl;
+
+    bench_report("polyfit qr", bench_ns_per_op([&]() {
+      Eigen::VectorXd c = polyfit(xvals, yvals, 3);
+      bench_keep(c);
+    }));
+    bench_report("fit_cubic", bench_ns_per_op([&]() {
+      Eigen::Vector4d c;
+      fit_cubic(xs.data(), ys.data(), xs.size(), c);
+      bench_keep(c);
+    }));
+    bench_report("fit_cubic qr fallback", bench_ns_per_op([&]() {
+      Eigen::Vector4d c;
+      fit_cubic(xs.data(), ys.data(), xs.size(), c, 2);
+      bench_keep(c);
+    }));
+  }
+
+  // Waypoints along a gentle curve, in the global coordinate system, in windows of 6,
+  // as from the simulator, and of more waypoints over the same arc, as a longer
+  // lookahead or denser map would give.
+  for (size_t window : {6, 64, 512}) {
+    const size_t num_track = 16 * window;
+    const double step = 0.48 / window; // radian
+    vector<double> track_x, track_y;
+    for (size_t i = 0; i < num_track; i++) {
+      track_x.push_back(200 * cos(step * i) - 40);
+      track_y.push_back(200 * sin(step * i) + 100);
+    }
+    std::cout << "  window of " << window << " waypoints" << std::endl;
+
+    size_t first = 0;
+    IncrementalCubicFit incremental;
+    vector<double> window_x(window), window_y(window), car_x(window), car_y(window);
+    auto slide = [&]() {
+      first = (first + 1) % (num_track - window);
+      window_x.assign(track_x.begin() + first, track_x.begin() + first + window);
+      window_y.assign(track_y.begin() + first, track_y.begin() + first + window);
+    };
+    bench_report("transform and fit_cubic, window slid by one", bench_ns_per_op([&]() {
+      slide();
+      double heading = step * first + M_PI / 2;
+      double c = cos(heading), s = sin(heading);
+      for (size_t i = 0; i < window; i++) {
+        double u = window_x[i] - track_x[first];
+        double v = window_y[i] - track_y[first];
+        car_x[i] = c * u + s * v;
+        car_y[i] = -s * u + c * v;
+      }
+      Eigen::Vector4d coeffs;
+      fit_cubic(car_x.data(), car_y.data(), window, coeffs);
+      bench_keep(coeffs);
+    }));
+    bench_report("incremental fit, window slid by one", bench_ns_per_op([&]() {
+      slide();
+      incremental.SetPoints(window_x, window_y);
+      Eigen::Vector4d coeffs;
+      incremental.Fit(track_x[first], track_y[first], step * first + M_PI / 2, coeffs);
+      bench_keep(coeffs);
+    }));
+  }
+}
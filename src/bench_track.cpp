@@ -0,0 +1,123 @@
+#include <math.h>
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "bench.h"
+#include "track_map.h"
+
+using std::vector;
+
+
+// The squared distance from (x, y) to the nearest segment of the track's table samples.
+static double brute_force_distance_squared(const TrackMap & map, double x, double y) {
+  double nearest = INFINITY;
+  TrackPoint a = map.At(0);
+  for (size_t i = 1; i <= map.size(); i++) {
+    TrackPoint b = map.At(i * map.resolution());
+    double dx = b.x - a.x;
+    double dy = b.y - a.y;
+    double length_squared = dx * dx + dy * dy;
+    double t = length_squared > 0 ? ((x - a.x) * dx + (y - a.y) * dy) / length_squared : 0;
+    t = std::max(0.0, std::min(1.0, t));
+    double ex = a.x + t * dx - x;
+    double ey = a.y + t * dy - y;
+    nearest = std::min(nearest, ex * ex + ey * ey);
+    a = b;
+  }
+  return nearest;
+}
+
+// Return false if the grid search disagrees with a brute force search.
+static bool check_track(const TrackMap & map) {
+  std::mt19937 random(7);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  vector<double> xs, ys;
+  for (double spread : {8.0, 2000.0, 1e7}) {
+    for (int i = 0; i < 32; i++) {
+      TrackPoint point = map.At(uniform(random) * map.length());
+      xs.push_back(point.x + (uniform(random) - 0.5) * spread);
+      ys.push_back(point.y + (uniform(random) - 0.5) * spread);
+    }
+  }
+
+  size_t num_mismatches = 0;
+  for (size_t i = 0; i < xs.size(); i++) {
+    double t, distance_squared;
+    map.index().Nearest(xs[i], ys[i], PolylineIndex::no_hint, t, distance_squared);
+    double expected = brute_force_distance_squared(map, xs[i], ys[i]);
+    if (fabs(sqrt(distance_squared) - sqrt(expected)) > 1e-9 * (1 + sqrt(expected))) {
+      num_mismatches++;
+    }
+  }
+  for (double x : {(double) NAN, (double) INFINITY}) {
+    double t, distance_squared;
+    map.index().Nearest(x, 0, PolylineIndex::no_hint, t, distance_squared);
+    if (!isinf(distance_squared)) {
+      num_mismatches++;
+    }
+  }
+  if (num_mismatches > 0) {
+    std::cerr << "  " << num_mismatches << " of " << xs.size() + 2
+      << " grid searches differ from brute force" << std::endl;
+  }
+  return num_mismatches == 0;
+}
+
+// Localization on the lake track, resampled to ever more points.
+//
+// `hinted` follows a vehicle driving along the track 2 m off center, 1 m per cycle,
+// from the previous cycle's result. `unhinted` localizes random positions near the
+// track with the grid alone.
+//
+// First, the grid search is checked against a brute force search over all segments,
+// from positions near the track, far outside the grid, and not finite.
+void bench_track() {
+  for (double resolution : {0.5, 0.01, 0.001}) {
+    TrackMap map(resolution);
+    if (!map.Load("../lake_track_waypoints.csv")) {
+      return;
+    }
+    const PolylineIndex & index = map.index();
+    if (!check_track(map)) {
+      return;
+    }
+
+    const size_t num_positions = 4096;
+    vector<double> xs(num_positions), ys(num_positions);
+    for (size_t i = 0; i < num_positions; i++) {
+      TrackPoint point = map.At(i * 1.0);
+      xs[i] = point.x - 2 * sin(point.heading);
+      ys[i] = point.y + 2 * cos(point.heading);
+    }
+    std::mt19937 random(42);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    vector<double> random_xs(num_positions), random_ys(num_positions);
+    for (size_t i = 0; i < num_positions; i++) {
+      TrackPoint point = map.At(uniform(random) * map.length());
+      double offset = (uniform(random) - 0.5) * 8;
+      random_xs[i] = point.x - offset * sin(point.heading);
+      random_ys[i] = point.y + offset * cos(point.heading);
+    }
+
+    std::cout << "  " << map.size() << " points, cell " << index.cell_size() << " m" << std::endl;
+
+    size_t hint = PolylineIndex::no_hint;
+    size_t i = 0;
+    bench_report("hinted", bench_ns_per_op([&]() {
+      double t, distance_squared;
+      hint = index.Nearest(xs[i], ys[i], hint, t, distance_squared);
+      i = (i + 1) % num_positions;
+      bench_keep(t);
+    }));
+
+    i = 0;
+    bench_report("unhinted", bench_ns_per_op([&]() {
+      double t, distance_squared;
+      size_t nearest = index.Nearest(random_xs[i], random_ys[i], PolylineIndex::no_hint,
+                                     t, distance_squared);
+      i = (i + 1) % num_positions;
+      bench_keep(nearest);
+    }));
+  }
+}
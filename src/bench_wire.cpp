@@ -0,0 +1,61 @@
+#include <string>
+#include "bench.h"
+#include "wire.h"
+
+using std::string;
+
+// JSON vs binary encoding of a typical telemetry and steer event pair.
+void bench_wire() {
+  string telemetry_json =
+    "[\"telemetry\",{\"ptsx\":[-32.16173,-43.49173,-61.09,-78.29172,-93.05002,-107.7717],"
+    "\"ptsy\":[113.361,105.941,92.88499,78.73102,65.34102,50.57938],"
+    "\"psi_unity\":4.120315,\"psi\":3.733651,\"x\":-40.62008,\"y\":108.7301,"
+    "\"steering_angle\":-0.003582587,\"throttle\":0.2154839,\"speed\":34.88513}]";
+
+  Telemetry telemetry;
+  parse_telemetry_json(telemetry_json, telemetry);
+
+  string telemetry_binary;
+  encode_telemetry(telemetry, telemetry_binary);
+
+  Actuation actuation;
+  actuation.steering_angle = -0.0123456789;
+  actuation.throttle = 0.987654321;
+  for (int i = 0; i < 12; i++) {
+    actuation.mpc_x.push_back(1.23456789 * i);
+    actuation.mpc_y.push_back(-0.0123456789 * i * i);
+  }
+  for (int i = 0; i < 6; i++) {
+    actuation.next_x.push_back(9.87654321 * i);
+    actuation.next_y.push_back(0.123456789 * i * i);
+  }
+
+  string steer_json = format_steer_json(actuation);
+  string steer_binary;
+  encode_steer(actuation, steer_binary);
+
+  std::cout << "  telemetry bytes: json " << telemetry_json.size()
+    << ", binary " << telemetry_binary.size() << std::endl;
+  std::cout << "  steer bytes: json " << steer_json.size()
+    << ", binary " << steer_binary.size() << std::endl;
+
+  bench_report("parse telemetry json", bench_ns_per_op([&]() {
+    Telemetry t;
+    parse_telemetry_json(telemetry_json, t);
+    bench_keep(t);
+  }));
+  bench_report("decode telemetry binary", bench_ns_per_op([&]() {
+    Telemetry t;
+    decode_telemetry(telemetry_binary.data(), telemetry_binary.size(), t);
+    bench_keep(t);
+  }));
+  bench_report("format steer json", bench_ns_per_op([&]() {
+    string out = format_steer_json(actuation);
+    bench_keep(out);
+  }));
+  bench_report("encode steer binary", bench_ns_per_op([&]() {
+    string out;
+    encode_steer(actuation, out);
+    bench_keep(out);
+  }));
+}
@@ -0,0 +1,241 @@
+#include "closed_loop.h"
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "MPC.h"
+#include "json.hpp"
+#include "vehicle_model.h"
+#include "wire.h"
+
+using std::string;
+using std::vector;
+using json = nlohmann::json;
+
+// Integration step of the vehicle, in seconds.
+static const double physics_dt = 0.005;
+
+// Number of waypoints in a telemetry event, as the simulator sends.
+static const size_t num_telemetry_pts = 6;
+
+// An actuation on its way to the car.
+struct PendingActuation {
+  double due; // second, virtual
+  double steering_angle;
+  double throttle;
+};
+
+bool ClosedLoopTrack::Load(const string & csv_path) {
+  std::ifstream csv(csv_path);
+  string line;
+  std::getline(csv, line); // header
+  for (size_t line_number = 2; std::getline(csv, line); line_number++) {
+    if (line.find_first_not_of(" \t\r") == string::npos) {
+      continue;
+    }
+    std::istringstream fields(line);
+    string x, y;
+    double wp_x, wp_y;
+    if (!std::getline(fields, x, ',') || !std::getline(fields, y, ',')
+        || !parse_csv_double(x, wp_x) || !parse_csv_double(y, wp_y)) {
+      std::cerr << "Malformed waypoint at " << csv_path << ":" << line_number << std::endl;
+      return false;
+    }
+    wps_x.push_back(wp_x);
+    wps_y.push_back(wp_y);
+  }
+  if (wps_x.size() < 3) {
+    std::cerr << "Failed to read waypoints from " << csv_path << std::endl;
+    return false;
+  }
+  return map.Build(wps_x, wps_y);
+}
+
+bool ClosedLoopFlags::Parse(int argc, char* argv[], int & i) {
+  if (strcmp(argv[i], "--waypoints") == 0 && i + 1 < argc) {
+    waypoints_path = argv[++i];
+  } else if (strcmp(argv[i], "--laps") == 0 && i + 1 < argc) {
+    run.laps = std::max(1, atoi(argv[++i]));
+  } else if (strcmp(argv[i], "--latency-ms") == 0 && i + 1 < argc) {
+    run.latency_ms = std::max(0, atoi(argv[++i]));
+  } else if (strcmp(argv[i], "--telemetry-ms") == 0 && i + 1 < argc) {
+    run.telemetry_ms = std::max(1, atoi(argv[++i]));
+  } else if (strcmp(argv[i], "--max-time") == 0 && i + 1 < argc) {
+    run.max_time = atof(argv[++i]);
+  } else if (strcmp(argv[i], "--max-cte") == 0 && i + 1 < argc) {
+    run.max_cte = atof(argv[++i]);
+  } else if (strcmp(argv[i], "--track-map") == 0 && i + 1 < argc) {
+    track_map_path = argv[++i];
+  } else if (strcmp(argv[i], "--speed-profile") == 0 && i + 1 < argc) {
+    speed_profile_path = argv[++i];
+  } else {
+    return run.controller.Parse(argc, argv, i);
+  }
+  return true;
+}
+
+bool ClosedLoopFlags::Load(ClosedLoopTrack & track, TrackMap & track_map) {
+  if (!track.Load(waypoints_path)) {
+    return false;
+  }
+  if (!track_map_path.empty()) {
+    if (!track_map.Load(track_map_path)) {
+      return false;
+    }
+    if (!speed_profile_path.empty() && !track_map.LoadSpeeds(speed_profile_path)) {
+      return false;
+    }
+    run.controller.track_map = &track_map;
+  } else if (run.controller.frenet || !speed_profile_path.empty()) {
+    std::cerr << "--frenet and --speed-profile require --track-map" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// The telemetry event of the car, as the simulator formats it, i.e. the `[...]` part of
+// `42[...]`. `first_wp` is the waypoint behind the car.
+static string format_telemetry_json(const VehicleState<double> & car, double steering_angle,
+                                    double throttle, const vector<double> & xs,
+                                    const vector<double> & ys, size_t first_wp) {
+  json data;
+  vector<double> ptsx(num_telemetry_pts), ptsy(num_telemetry_pts);
+  for (size_t i = 0; i < num_telemetry_pts; i++) {
+    ptsx[i] = xs[(first_wp + i) % xs.size()];
+    ptsy[i] = ys[(first_wp + i) % ys.size()];
+  }
+  data["ptsx"] = ptsx;
+  data["ptsy"] = ptsy;
+  data["psi"] = fmod(fmod(car.psi, 2 * M_PI) + 2 * M_PI, 2 * M_PI);
+  data["psi_unity"] = fmod(fmod(M_PI / 2 - car.psi, 2 * M_PI) + 2 * M_PI, 2 * M_PI);
+  data["x"] = car.x;
+  data["y"] = car.y;
+  data["steering_angle"] = steering_angle;
+  data["throttle"] = throttle;
+  data["speed"] = car.v * mps_to_mph;
+  return "[\"telemetry\"," + data.dump() + "]";
+}
+
+void run_closed_loop(const ClosedLoopTrack & track, const ClosedLoopOptions & options,
+                     ClosedLoopResult & result) {
+  typedef std::chrono::steady_clock clock;
+  const vector<double> & wps_x = track.waypoints_x();
+  const vector<double> & wps_y = track.waypoints_y();
+  const TrackMap & centerline = track.centerline();
+  size_t num_wps = wps_x.size();
+
+  // The virtual clock, in seconds since `epoch`.
+  const clock::time_point epoch = clock::now();
+  double sim_time = 0;
+  ControllerOptions controller_options = options.controller;
+  controller_options.now = [&epoch, &sim_time]() {
+    return epoch + std::chrono::duration_cast<clock::duration>(
+      std::chrono::duration<double>(sim_time));
+  };
+  // The controller predicts over the latency it is told of, as the server's does.
+  controller_options.actuation_delay_ms = options.latency_ms;
+  Controller controller(controller_options);
+
+  // Start on the first waypoint, at rest, heading to the next one.
+  VehicleState<double> car {wps_x[0], wps_y[0],
+    atan2(wps_y[1] - wps_y[0], wps_x[1] - wps_x[0]), 0};
+  double steering_angle = 0; // as the simulator reports it, positive for right turn
+  double throttle = 0;
+  size_t wp = 0; // the waypoint behind the car
+
+  size_t score_hint = TrackMap::no_hint;
+  double last_s, offset;
+  centerline.Project(car.x, car.y, score_hint, last_s, offset);
+  double lap_start = 0;
+
+  result = ClosedLoopResult();
+  double sum_cte2 = 0, sum_speed = 0, sum_solve_time = 0;
+  size_t num_samples = 0;
+
+  std::deque<PendingActuation> pending;
+  double latency = options.latency_ms / 1000.0;
+  double telemetry_interval = options.telemetry_ms / 1000.0;
+  double next_telemetry = 0;
+
+  while (result.lap_times.size() < options.laps && sim_time < options.max_time &&
+         !result.off_track) {
+    if (sim_time >= next_telemetry) {
+      next_telemetry += telemetry_interval;
+
+      // The waypoint behind the car: advance while the car is past the next one.
+      for (size_t i = 0; i < num_wps; i++) {
+        size_t next_wp = (wp + 1) % num_wps;
+        size_t after_wp = (wp + 2) % num_wps;
+        double dx = wps_x[after_wp] - wps_x[next_wp];
+        double dy = wps_y[after_wp] - wps_y[next_wp];
+        if ((car.x - wps_x[next_wp]) * dx + (car.y - wps_y[next_wp]) * dy < 0) {
+          break;
+        }
+        wp = next_wp;
+      }
+
+      Telemetry telemetry;
+      parse_telemetry_json(
+        format_telemetry_json(car, steering_angle, throttle, wps_x, wps_y, wp), telemetry);
+
+      Actuation actuation;
+      auto solve_start = clock::now();
+      bool solved = controller.Control(telemetry, []() { return false; }, actuation);
+      double solve_time = std::chrono::duration<double>(clock::now() - solve_start).count();
+      controller.Speculate();
+      sum_solve_time += solve_time;
+      result.max_solve_time = std::max(result.max_solve_time, solve_time);
+      result.num_solves++;
+      if (solve_time > latency) {
+        result.deadline_misses++;
+      }
+      if (solved) {
+        pending.push_back(PendingActuation {sim_time + latency, actuation.steering_angle,
+                                            actuation.throttle});
+        controller.RecordLatency(latency);
+      }
+    }
+    while (!pending.empty() && pending.front().due <= sim_time) {
+      steering_angle = pending.front().steering_angle;
+      throttle = pending.front().throttle;
+      pending.pop_front();
+    }
+
+    // The model takes positive steering for left turn, and throttle as acceleration.
+    car = step(car, VehicleInput<double> {-steering_angle, throttle}, physics_dt);
+    sim_time += physics_dt;
+
+    double s;
+    centerline.Project(car.x, car.y, score_hint, s, offset);
+    double ds = s - last_s;
+    // Across the start of the loop.
+    if (ds < -centerline.length() / 2) {
+      ds += centerline.length();
+    } else if (ds > centerline.length() / 2) {
+      ds -= centerline.length();
+    }
+    result.distance += ds;
+    last_s = s;
+    if (result.distance >= centerline.length() * (result.lap_times.size() + 1)) {
+      result.lap_times.push_back(sim_time - lap_start);
+      lap_start = sim_time;
+    }
+
+    sum_cte2 += offset * offset;
+    result.max_cte = std::max(result.max_cte, fabs(offset));
+    sum_speed += car.v;
+    result.max_speed = std::max(result.max_speed, car.v * mps_to_mph);
+    num_samples++;
+    result.off_track = fabs(offset) > options.max_cte;
+  }
+
+  result.time = sim_time;
+  result.rms_cte = sqrt(sum_cte2 / std::max<size_t>(1, num_samples));
+  result.mean_speed = sum_speed / std::max<size_t>(1, num_samples) * mps_to_mph;
+  result.mean_solve_time = sum_solve_time / std::max<size_t>(1, result.num_solves);
+}
@@ -0,0 +1,76 @@
+#ifndef CLOSED_LOOP_H
+#define CLOSED_LOOP_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "controller.h"
+#include "track_map.h"
+
+// A closed-loop run of the controller without Unity, on a virtual clock: the vehicle
+// model of vehicle_model.h is integrated around a track, sends the controller the same
+// telemetry events as the simulator (see DATA.md), and applies each actuation after the
+// artificial latency. The simulation never sleeps, so a lap takes as long as its solves.
+struct ClosedLoopOptions {
+  // The run sets its time source, and predicts over `latency_ms`.
+  ControllerOptions controller;
+  size_t laps = 1;
+  int latency_ms = 100; // from receiving telemetry to applying its actuation
+  int telemetry_ms = 100; // between telemetry events
+  double max_time = 600; // second, virtual
+  double max_cte = 5; // meter; beyond it the car is off the track, and the run ends
+};
+
+struct ClosedLoopResult {
+  std::vector<double> lap_times; // second, virtual
+  bool off_track;
+  double time; // second, virtual, when the run ended
+  double distance; // meter, along the centerline
+  double rms_cte; // meter, from the centerline
+  double max_cte;
+  double mean_speed; // mile/hour
+  double max_speed;
+  size_t num_solves;
+  double mean_solve_time; // second, wall time in the controller per telemetry event
+  double max_solve_time;
+  size_t deadline_misses; // telemetry events that took longer than the latency to solve
+};
+
+// The track of closed-loop runs: the waypoints, in driving order, and the centerline
+// through them, which the car is scored against. Read only, so runs may share it.
+class ClosedLoopTrack {
+ public:
+  // From a CSV file with an `x,y` header, such as lake_track_waypoints.csv.
+  bool Load(const std::string & csv_path);
+
+  const std::vector<double> & waypoints_x() const { return wps_x; }
+  const std::vector<double> & waypoints_y() const { return wps_y; }
+  const TrackMap & centerline() const { return map; }
+
+ private:
+  std::vector<double> wps_x;
+  std::vector<double> wps_y;
+  TrackMap map;
+};
+
+// The command line options of the closed-loop tools. See simulator.cpp.
+struct ClosedLoopFlags {
+  ClosedLoopOptions run;
+  std::string waypoints_path = "../lake_track_waypoints.csv";
+  std::string track_map_path;
+  std::string speed_profile_path;
+
+  // If `argv[i]` is one of these options, consume it and its value, if any, and return
+  // true. Exits on an invalid `--mpc` value.
+  bool Parse(int argc, char* argv[], int & i);
+
+  // Load the track, and the controller's track map, if any, which must outlive the runs.
+  bool Load(ClosedLoopTrack & track, TrackMap & track_map);
+};
+
+// Drive from the first waypoint, at rest, until `options.laps` laps are done, the car
+// is off the track, or `options.max_time` is up.
+void run_closed_loop(const ClosedLoopTrack & track, const ClosedLoopOptions & options,
+                     ClosedLoopResult & result);
+
+#endif /* CLOSED_LOOP_H */
@@ -0,0 +1,424 @@
+#include "controller.h"
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include "Eigen-3.3/Eigen/Dense"
+#include "affine.h"
+#include "polyfit.h"
+#include "tools.h"
+
+using std::vector;
+using Eigen::VectorXd;
+
+Controller::Controller(const ControllerOptions & options) :
+  options(options),
+  created_time(Now()),
+  last_timings(),
+  mpc(options.mpc),
+  frenet_mpc(options.mpc),
+  track_hint(TrackMap::no_hint),
+  // In the simulation, vehicle starts with 0 steering and 0 throttle.
+  last_steering(0),
+  last_throttle(0),
+  has_last_telemetry(false),
+  prev_steering(0),
+  prev_throttle(0),
+  has_speculation(false),
+  num_speculation_hits(0),
+  num_speculation_misses(0) {
+  actuation_history.Push(PastActuation {0, 0, created_time});
+  if (options.sensitivity_max_change > 0) {
+    mpc.EnableSensitivityUpdates(options.sensitivity_max_change, options.full_solve_interval);
+  }
+}
+
+bool ControllerOptions::Parse(int argc, char* argv[], int & i) {
+  if (strcmp(argv[i], "one") == 0) {
+    strategy = one;
+  } else if (strcmp(argv[i], "avg") == 0) {
+    strategy = avg;
+  } else if (strcmp(argv[i], "iterative") == 0) {
+    strategy = iterative;
+  } else if (strcmp(argv[i], "--frenet") == 0) {
+    frenet = true;
+  } else if (strcmp(argv[i], "--adaptive-delay") == 0) {
+    adaptive_delay = true;
+  } else if (strcmp(argv[i], "--delay-quantile") == 0 && i + 1 < argc) {
+    adaptive_delay = true;
+    delay_quantile = atof(argv[++i]);
+  } else if (strcmp(argv[i], "--speculate") == 0) {
+    speculate = true;
+  } else if (strcmp(argv[i], "--incremental-fit") == 0) {
+    incremental_fit = true;
+  } else if (strcmp(argv[i], "--sensitivity-updates") == 0 && i + 1 < argc) {
+    sensitivity_max_change = atof(argv[++i]);
+  } else if (strcmp(argv[i], "--full-solve-interval") == 0 && i + 1 < argc) {
+    full_solve_interval = std::max(1, atoi(argv[++i]));
+  } else if (strcmp(argv[i], "--mpc") == 0 && i + 1 < argc) {
+    if (!mpc.Parse(argv[++i])) {
+      exit(-1);
+    }
+  } else {
+    return false;
+  }
+  return true;
+}
+
+double Controller::PredictionHorizon() const {
+  if (!options.adaptive_delay || latency.empty()) {
+    return options.actuation_delay_ms / 1000.0;
+  }
+  return options.delay_quantile > 0 ? latency.quantile(options.delay_quantile) : latency.mean();
+}
+
+void Controller::Prepare(const Telemetry & telemetry, clock::time_point now,
+                         SolverInput & input, ControlTimings & timings) {
+  auto mark = clock::now();
+  const vector<double> & ptsx = telemetry.ptsx;
+  const vector<double> & ptsy = telemetry.ptsy;
+  double px = telemetry.x;
+  double py = telemetry.y;
+  double psi = telemetry.psi; // radian
+  double v = telemetry.speed; // mile/hour
+  v /= mps_to_mph; // meter/sec
+
+  // transform the global coordinate to car's coordinate system
+  size_t num_pts = std::min(ptsx.size(), ptsy.size());
+  input.ptsx_wrt_car.resize(num_pts);
+  input.ptsy_wrt_car.resize(num_pts);
+  translate_then_rotate(ptsx.data(), ptsy.data(), num_pts, -px, -py, -psi,
+                        input.ptsx_wrt_car.data(), input.ptsy_wrt_car.data());
+  timings.transform = lap(mark);
+
+  input.pose_x = px;
+  input.pose_y = py;
+  input.pose_psi = psi;
+
+  // Update and add state vars in the car's coordinate system.
+  // In the Frenet frame, cte and epsi are not used.
+  px = py = psi = 0;
+  double cte = 0;
+  double epsi = 0;
+  if (!options.frenet) {
+    // Too few or degenerate waypoints leave the reference straight ahead.
+    Eigen::Vector4d cubic = Eigen::Vector4d::Zero();
+    if (options.incremental_fit) {
+      reference_fit.SetPoints(ptsx, ptsy);
+      reference_fit.Fit(input.pose_x, input.pose_y, input.pose_psi, cubic);
+    } else {
+      fit_cubic(input.ptsx_wrt_car.data(), input.ptsy_wrt_car.data(),
+                input.ptsx_wrt_car.size(), cubic);
+    }
+    input.coeffs = cubic;
+    cte = input.coeffs[0];
+    epsi = -atan(input.coeffs[1]);
+    timings.fit = lap(mark);
+  }
+
+  // Now, determine the init state to pass to the solver.
+
+  // How far ahead to predict, i.e. the actuation delay.
+  double horizon_s = PredictionHorizon();
+  input.horizon_s = horizon_s;
+
+  double aggregated_steering = 0; // used by `one` and `avg` strategies only
+  double aggregated_throttle = 0; // ditto
+
+  // How long ago from the present the i-th newest actuation was.
+  auto age = [this, &now](size_t i) {
+    return std::chrono::duration<double>(now - actuation_history[i].time).count();
+  };
+
+  size_t oldest_i = 0; // used by `avg` and `iterative` strategies only
+
+  if (options.strategy == one) {
+    aggregated_steering = last_steering;
+    aggregated_throttle = last_throttle;
+  } else {
+    // Determine the newest actuation that is older than the actuation delay.
+    // If there is none older than the actuation delay, then choose the oldest in history.
+    // Business logic guarantees the history has at least one item, so this is safe.
+    while (oldest_i + 1 < actuation_history.size() && age(oldest_i) <= horizon_s) {
+      oldest_i++;
+    }
+
+    if (options.strategy == avg) {
+      // Average each actuation variable over the actuation delay, weighted by how long
+      // each actuation is in effect during the delay.
+      double total_dt = 0;
+      for (size_t i = oldest_i + 1; i-- > 0; ) {
+        double earlier_age = std::min(age(i), horizon_s); // cap by actuation delay
+        double later_age = i == 0 ? 0 : age(i - 1);
+        double dt = earlier_age - later_age;
+
+        aggregated_steering += actuation_history[i].steering * dt;
+        aggregated_throttle += actuation_history[i].throttle * dt;
+        total_dt += dt;
+      }
+      if (total_dt > 0) {
+        aggregated_steering /= total_dt;
+        aggregated_throttle /= total_dt;
+      } else {
+        aggregated_steering = actuation_history[0].steering;
+        aggregated_throttle = actuation_history[0].throttle;
+      }
+    }
+  }
+  input.oldest_i = oldest_i;
+
+  if (options.strategy == one || options.strategy == avg) {
+    // global kinetic model for the actuation delay, with the aggregated actuation
+    VehicleState<double> delayed = step(
+      VehicleState<double> {px, py, psi, v},
+      VehicleInput<double> {aggregated_steering, aggregated_throttle}, horizon_s);
+    double cte_delayed = cte + (delayed.y - py);
+    double epsi_delayed = epsi + (delayed.psi - psi);
+
+    input.init_state = {delayed.x, delayed.y, delayed.psi, delayed.v, cte_delayed, epsi_delayed};
+  } else {
+    input.init_state = {px, py, psi, v, cte, epsi};
+
+    // Iteratively update the states using global kinetic model to estimate
+    // what the state will likely look like after actuation delay from the present.
+    // Each actuation is applied for as long as it is in effect during the delay.
+    for (size_t i = oldest_i + 1; i-- > 0; ) {
+      double earlier_age = std::min(age(i), horizon_s); // cap by actuation delay
+      double later_age = i == 0 ? 0 : age(i - 1);
+      double dt = earlier_age - later_age;
+
+      if (dt > 0) {
+        input.init_state = global_kinetic_model(
+          input.init_state, actuation_history[i].steering, actuation_history[i].throttle, dt);
+      }
+    }
+  }
+
+  timings.predict = lap(mark);
+
+  if (options.track_map != nullptr) {
+    Localize(input);
+    timings.localize = lap(mark);
+  }
+}
+
+void Controller::Localize(SolverInput & input) {
+  const TrackMap & map = *options.track_map;
+
+  // The predicted pose, back in the global coordinate system.
+  double cos_psi = cos(input.pose_psi);
+  double sin_psi = sin(input.pose_psi);
+  double x = input.pose_x + input.init_state[0] * cos_psi - input.init_state[1] * sin_psi;
+  double y = input.pose_y + input.init_state[0] * sin_psi + input.init_state[1] * cos_psi;
+  double psi = input.pose_psi + input.init_state[2];
+
+  double offset;
+  map.Project(x, y, track_hint, input.track_s, offset);
+  double heading_error = psi - map.At(input.track_s).heading;
+  heading_error = atan2(sin(heading_error), cos(heading_error));
+  input.frenet_state = {0, offset, heading_error, input.init_state[3]};
+
+  if (options.frenet) {
+    // Sample the curvature more coarsely than the map, which the kernel then smooths.
+    // Cover the horizon at the speed limit, and a few samples beyond.
+    input.curvature.spacing = 2.5;
+    size_t num_samples = (size_t) ceil(frenet_mpc.Lookahead() / input.curvature.spacing) + 3;
+    input.curvature.curvature.resize(num_samples);
+    for (size_t j = 0; j < num_samples; j++) {
+      input.curvature.curvature[j] = map.At(input.track_s + j * input.curvature.spacing).curvature;
+    }
+  }
+
+  if (map.has_speeds()) {
+    // The target speeds where the vehicle would be at each timestep, if it kept to them.
+    input.speed_reference.resize(mpc.horizon());
+    double s = input.track_s;
+    for (size_t t = 0; t < mpc.horizon(); t++) {
+      input.speed_reference[t] = map.SpeedAt(s);
+      s += input.speed_reference[t] * mpc.timestep();
+    }
+  }
+}
+
+void Controller::Solve(const SolverInput & input, bool shift_warm_start, double & steering,
+                       double & throttle, vector<double> & mpc_x, vector<double> & mpc_y) {
+  if (!options.frenet) {
+    std::tie(steering, throttle, mpc_x, mpc_y) =
+      mpc.Solve(input.init_state, input.coeffs, input.speed_reference, shift_warm_start);
+    return;
+  }
+
+  vector<double> solved_s, solved_n;
+  std::tie(steering, throttle, solved_s, solved_n) =
+    frenet_mpc.Solve(input.frenet_state, input.curvature, input.speed_reference,
+                     shift_warm_start);
+
+  // From the Frenet frame to the global coordinate system, then to the car's.
+  const TrackMap & map = *options.track_map;
+  mpc_x.resize(solved_s.size());
+  mpc_y.resize(solved_s.size());
+  for (size_t t = 0; t < solved_s.size(); t++) {
+    TrackPoint point = map.At(input.track_s + solved_s[t]);
+    mpc_x[t] = point.x - solved_n[t] * sin(point.heading);
+    mpc_y[t] = point.y + solved_n[t] * cos(point.heading);
+  }
+  translate_then_rotate(mpc_x.data(), mpc_y.data(), mpc_x.size(), -input.pose_x, -input.pose_y,
+                        -input.pose_psi, mpc_x.data(), mpc_y.data());
+}
+
+void Controller::Commit(const SolverInput & input, clock::time_point now, double steering,
+                        double throttle, const vector<double> & mpc_x,
+                        const vector<double> & mpc_y, Actuation & actuation) {
+  prev_steering = last_steering;
+  prev_throttle = last_throttle;
+  last_steering = steering;
+  last_throttle = throttle;
+
+  actuation.steering_angle = -last_steering; // udacity simulator takes positive values for right turn
+  actuation.throttle = last_throttle;
+  actuation.mpc_x = mpc_x;
+  actuation.mpc_y = mpc_y;
+  actuation.next_x = eigen_to_std_vector(input.ptsx_wrt_car);
+  actuation.next_y = eigen_to_std_vector(input.ptsy_wrt_car);
+
+  actuation.profile_dt = mpc.timestep();
+  actuation.profile_delay = input.horizon_s;
+  bool has_profile = !options.frenet ?
+    mpc.ActuationProfile(actuation.steering_profile, actuation.throttle_profile) :
+    frenet_mpc.ActuationProfile(actuation.steering_profile, actuation.throttle_profile);
+  if (has_profile) {
+    for (double & steering_angle : actuation.steering_profile) {
+      steering_angle = -steering_angle;
+    }
+  } else {
+    actuation.steering_profile.clear();
+    actuation.throttle_profile.clear();
+  }
+
+  if (options.strategy == avg || options.strategy == iterative) {
+    // Actuations older than the one in effect at the start of the delay window are no
+    // longer needed. Then record this actuation, capturing the time of actuation
+    // (just before the artificially introduced latency).
+    actuation_history.Truncate(input.oldest_i + 1);
+    actuation_history.Push(PastActuation {last_steering, last_throttle, now});
+  }
+}
+
+// Whether the actual telemetry is close enough to the expected one
+// for the solution of one to be used for the other.
+static bool within_tolerance(const Telemetry & expected, const Telemetry & actual,
+                             const ControllerOptions & options) {
+  if (expected.ptsx != actual.ptsx || expected.ptsy != actual.ptsy) {
+    return false;
+  }
+  double dpsi = fmod(fabs(expected.psi - actual.psi), 2 * M_PI);
+  dpsi = std::min(dpsi, 2 * M_PI - dpsi);
+  return
+    hypot(expected.x - actual.x, expected.y - actual.y) <= options.speculation_position_tolerance &&
+    dpsi <= options.speculation_psi_tolerance &&
+    fabs(expected.speed - actual.speed) <= options.speculation_speed_tolerance;
+}
+
+bool Controller::Control(const Telemetry & telemetry, const std::function<bool()> & should_cancel,
+                         Actuation & actuation) {
+  auto now = Now();
+
+  ControlTimings & timings = last_timings;
+  timings = ControlTimings();
+  timings.received = now;
+
+  SolverInput input;
+  Prepare(telemetry, now, input, timings);
+  auto mark = clock::now();
+
+  bool shift_warm_start = true;
+  bool speculation_hit = false;
+  if (has_speculation) {
+    speculation_hit = within_tolerance(speculated_telemetry, telemetry, options);
+    // On a miss, the speculative solution is for about the same time as this telemetry,
+    // so warm start the solver with it unshifted.
+    shift_warm_start = false;
+  }
+
+  if (speculation_hit) {
+    num_speculation_hits++;
+    timings.committed = Now();
+    Commit(input, timings.committed, speculated_steering, speculated_throttle,
+           speculated_mpc_x, speculated_mpc_y, actuation);
+    timings.commit = lap(mark);
+  } else {
+    if (should_cancel()) {
+      has_speculation = false;
+      return false;
+    }
+
+    // Calculate steering angle and throttle using MPC.
+    double steering, throttle;
+    vector<double> mpc_x, mpc_y;
+    mark = clock::now();
+    Solve(input, shift_warm_start, steering, throttle, mpc_x, mpc_y);
+    timings.solve = lap(mark);
+    timings.solve_stages = options.frenet ? frenet_mpc.timings() : mpc.timings();
+
+    if (should_cancel()) {
+      has_speculation = false;
+      return false;
+    }
+
+    if (has_speculation) {
+      num_speculation_misses++;
+    }
+    timings.committed = Now();
+    Commit(input, timings.committed, steering, throttle, mpc_x, mpc_y, actuation);
+    timings.commit = lap(mark);
+  }
+  has_speculation = false;
+
+  if (has_last_telemetry) {
+    telemetry_interval.Record(std::chrono::duration<double>(now - last_received).count());
+  }
+  last_telemetry = telemetry;
+  last_received = now;
+  has_last_telemetry = true;
+  return true;
+}
+
+bool Controller::Speculate() {
+  if (!options.speculate || !has_last_telemetry || telemetry_interval.empty()) {
+    return false;
+  }
+
+  // Predict the pose when the next telemetry is sent, in the global coordinate system.
+  // Until the delay elapses, the previous actuation remains in effect, then the one
+  // just commanded.
+  double interval_s = telemetry_interval.mean();
+  double horizon_s = PredictionHorizon();
+  vector<double> state = {
+    last_telemetry.x, last_telemetry.y, last_telemetry.psi,
+    last_telemetry.speed / mps_to_mph, 0, 0};
+  state = global_kinetic_model(state, prev_steering, prev_throttle,
+                               std::min(horizon_s, interval_s));
+  if (interval_s > horizon_s) {
+    state = global_kinetic_model(state, last_steering, last_throttle,
+                                 interval_s - horizon_s);
+  }
+
+  speculated_telemetry = last_telemetry;
+  speculated_telemetry.x = state[0];
+  speculated_telemetry.y = state[1];
+  speculated_telemetry.psi = state[2];
+  speculated_telemetry.speed = state[3] * mps_to_mph;
+
+  auto expected_received = last_received +
+    std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(interval_s));
+
+  SolverInput input;
+  ControlTimings timings;
+  Prepare(speculated_telemetry, expected_received, input, timings);
+
+  Solve(input, true, speculated_steering, speculated_throttle,
+        speculated_mpc_x, speculated_mpc_y);
+  has_speculation = true;
+  return true;
+}
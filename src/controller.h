@@ -0,0 +1,245 @@
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+#include <chrono>
+#include <functional>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+#include "actuation_history.h"
+#include "incremental_fit.h"
+#include "latency_estimator.h"
+#include "track_map.h"
+
+enum actuation_delay_strategy {
+  one,
+  avg,
+  iterative
+};
+
+// The fields of a telemetry event that the controller uses. See DATA.md.
+struct Telemetry {
+  std::vector<double> ptsx;
+  std::vector<double> ptsy;
+  double x;
+  double y;
+  double psi; // radian
+  double speed; // mile/hour
+};
+
+// The fields of a steer event.
+struct Actuation {
+  double steering_angle; // positive values for right turn, as the simulator expects
+  double throttle;
+  std::vector<double> mpc_x; // the MPC predicted trajectory, in car's coordinate system
+  std::vector<double> mpc_y;
+  std::vector<double> next_x; // the waypoints, in car's coordinate system
+  std::vector<double> next_y;
+
+  // The optimal actuations over the whole horizon, in the same sign convention, every
+  // `profile_dt` seconds from `profile_delay` seconds after the telemetry was received.
+  // Empty if the solver failed.
+  std::vector<double> steering_profile;
+  std::vector<double> throttle_profile;
+  double profile_dt;
+  double profile_delay;
+};
+
+// How the controller compensates for the actuation delay, and whether it speculates.
+struct ControllerOptions {
+  actuation_delay_strategy strategy = one;
+
+  // The horizon and cost weights of the solver, of either formulation.
+  MPCConfig mpc;
+
+  // The delay strategies predict the state `actuation_delay_ms` ahead, unless
+  // `adaptive_delay` is set, in which case they predict as far ahead as the measured
+  // latency: its moving average if `delay_quantile` is zero, else that quantile of it.
+  int actuation_delay_ms = 100;
+  bool adaptive_delay = false;
+  double delay_quantile = 0;
+
+  // After each actuation, whether to solve ahead for the telemetry expected next.
+  // The speculative solution is used as is if the actual telemetry is within these
+  // tolerances of the expected one, and to warm start the solver otherwise.
+  bool speculate = false;
+  double speculation_position_tolerance = 0.1; // meter
+  double speculation_psi_tolerance = 0.01; // radian
+  double speculation_speed_tolerance = 0.2; // mile/hour
+
+  // If positive, between full solves, update the previous optimum by its sensitivity to
+  // the new state and waypoints, as long as no actuation changes by more than this
+  // fraction of its range. See `MPC::EnableSensitivityUpdates`. Cartesian formulation only.
+  double sensitivity_max_change = 0;
+  unsigned int full_solve_interval = 5;
+
+  // If set, the vehicle is localized on this map, and if the map has target speeds, the
+  // solver tracks them rather than the speed limit. Must outlive the controller.
+  const TrackMap *track_map = nullptr;
+
+  // Whether to fit the waypoints incrementally across telemetry events, with
+  // `IncrementalCubicFit`, rather than transforming and fitting them from scratch.
+  bool incremental_fit = false;
+
+  // Whether to solve in the Frenet frame of the track map, with `FrenetMPC`, instead of
+  // fitting a polynomial to the waypoints of each telemetry event. Requires `track_map`.
+  bool frenet = false;
+
+  // The time source for stamping telemetry and actuations. The steady clock if empty;
+  // a simulation on a virtual clock sets its own.
+  std::function<std::chrono::steady_clock::time_point()> now;
+
+  // If `argv[i]` is one of the server's controller options, e.g. `avg` or `--speculate`,
+  // consume it and its value, if any, and return true. Exits on an invalid `--mpc` value.
+  bool Parse(int argc, char* argv[], int & i);
+};
+
+// Where the wall time of one `Control` call went, in seconds, and the times of the
+// controller's clock that it stamped the telemetry and the actuation with.
+// Stages that did not run take zero.
+struct ControlTimings {
+  std::chrono::steady_clock::time_point received;
+  std::chrono::steady_clock::time_point committed; // if the call was not cancelled
+  double transform; // of the waypoints into the car's coordinate system
+  double fit; // of the reference polynomial, if not in the Frenet frame
+  double predict; // of the state after the actuation delay
+  double localize; // on the track map, if any
+  double solve; // unless the speculative solution was used
+  SolveTimings solve_stages; // of `solve`, in the MPC
+  double commit;
+};
+
+// The controller state of one vehicle: the MPC instance, with its warm start,
+// and the history of actuations used to compensate for the actuation delay.
+//
+// Not thread safe. Each vehicle must be controlled from one thread at a time.
+class Controller {
+ public:
+  explicit Controller(const ControllerOptions & options);
+
+  // Run the controller on one telemetry event.
+  //
+  // `should_cancel` is polled before and after solving. If it returns true, false is
+  // returned, nothing is committed to the actuation history and any speculative solution
+  // is discarded. What the call already computed persists: the track position and the
+  // reference fit, and after the solve, the MPC's warm start and sensitivity state.
+  bool Control(const Telemetry & telemetry, const std::function<bool()> & should_cancel,
+               Actuation & actuation);
+
+  // Solve ahead for the telemetry expected next, given the actuation just commanded
+  // and the measured interval between telemetry events. Call between `Control` calls.
+  // Return false if speculation is disabled, or there is not enough history for it.
+  bool Speculate();
+
+  // Record how long it took from receiving a telemetry event to sending its actuation.
+  // May be called from any thread.
+  void RecordLatency(double seconds) { latency.Record(seconds); }
+
+  const LatencyEstimator & measured_latency() const { return latency; }
+
+  // Of the last `Control` call.
+  const ControlTimings & timings() const { return last_timings; }
+
+  // When the controller was constructed, by its clock. Its actuation history starts then.
+  std::chrono::steady_clock::time_point created() const { return created_time; }
+
+  // How far ahead the delay strategies predict the state, in seconds.
+  double PredictionHorizon() const;
+
+  // Number of telemetry events whose speculative solution was used as is,
+  // and of those for which it only warm started the solver.
+  size_t speculation_hits() const { return num_speculation_hits; }
+  size_t speculation_misses() const { return num_speculation_misses; }
+
+ private:
+  typedef std::chrono::steady_clock clock;
+
+  clock::time_point Now() const { return options.now ? options.now() : clock::now(); }
+
+  // The inputs to the solver, derived from a telemetry event.
+  struct SolverInput {
+    std::vector<double> init_state;
+    Eigen::VectorXd coeffs;
+    Eigen::VectorXd ptsx_wrt_car;
+    Eigen::VectorXd ptsy_wrt_car;
+    // The actuations that are in effect during the actuation delay are
+    // actuation_history[oldest_i], ..., actuation_history[0].
+    size_t oldest_i;
+    // How far ahead `init_state` is predicted, in seconds.
+    double horizon_s;
+
+    // The pose of the telemetry event, in the global coordinate system.
+    double pose_x;
+    double pose_y;
+    double pose_psi;
+
+    // With a track map only: the Frenet state, from arc length `track_s` of the map,
+    // and the curvature ahead of it (Frenet formulation only).
+    std::vector<double> frenet_state;
+    double track_s;
+    CurvatureProfile curvature;
+
+    // The target speed at each timestep, or empty for the speed limit.
+    Eigen::VectorXd speed_reference;
+  };
+
+  // Derive the solver input from a telemetry event received at `now`.
+  void Prepare(const Telemetry & telemetry, clock::time_point now, SolverInput & input,
+               ControlTimings & timings);
+
+  // Localize the predicted state on the track map, and look up what lies ahead.
+  void Localize(SolverInput & input);
+
+  // Solve with the formulation the options select. Output the optimal trajectory in the
+  // car's coordinate system.
+  void Solve(const SolverInput & input, bool shift_warm_start, double & steering,
+             double & throttle, std::vector<double> & mpc_x, std::vector<double> & mpc_y);
+
+  // Adopt an optimal actuation as the one sent at `now`, and fill in the steer event.
+  void Commit(const SolverInput & input, clock::time_point now, double steering,
+              double throttle, const std::vector<double> & mpc_x,
+              const std::vector<double> & mpc_y, Actuation & actuation);
+
+  ControllerOptions options;
+
+  clock::time_point created_time;
+  ControlTimings last_timings;
+
+  MPC mpc;
+  FrenetMPC frenet_mpc;
+
+  // Used with `incremental_fit` only.
+  IncrementalCubicFit reference_fit;
+
+  // From the previous projection onto the track map. See `TrackMap::Project`.
+  size_t track_hint;
+
+  LatencyEstimator latency;
+
+  double last_steering;
+  double last_throttle;
+
+  // Used by `avg` and `iterative` strategies only.
+  ActuationHistory actuation_history;
+
+  // The previous telemetry event, when it arrived, and the actuation in effect
+  // before the one commanded in reply to it. Used for speculation.
+  Telemetry last_telemetry;
+  clock::time_point last_received;
+  bool has_last_telemetry;
+  double prev_steering;
+  double prev_throttle;
+  LatencyEstimator telemetry_interval;
+
+  // The telemetry expected next, and the solution for it.
+  bool has_speculation;
+  Telemetry speculated_telemetry;
+  double speculated_steering;
+  double speculated_throttle;
+  std::vector<double> speculated_mpc_x;
+  std::vector<double> speculated_mpc_y;
+  size_t num_speculation_hits;
+  size_t num_speculation_misses;
+};
+
+#endif /* CONTROLLER_H */
@@ -0,0 +1,242 @@
+#include "incremental_fit.h"
+#include <math.h>
+#include <algorithm>
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "polyfit.h"
+
+using std::vector;
+
+// Rounding accumulates over downdates, so the moments are recomputed every so often.
+static const size_t rebuild_interval = 64;
+
+static const double binomial[7][7] = {
+  {1},
+  {1, 1},
+  {1, 2, 1},
+  {1, 3, 3, 1},
+  {1, 4, 6, 4, 1},
+  {1, 5, 10, 10, 5, 1},
+  {1, 6, 15, 20, 15, 6, 1}};
+
+IncrementalCubicFit::IncrementalCubicFit() :
+  anchor_x(0),
+  anchor_y(0),
+  num_downdates(0) {
+  Rebuild();
+}
+
+void IncrementalCubicFit::Accumulate(double x, double y, double sign) {
+  double powers_u[max_degree + 1];
+  double powers_v[max_degree + 1];
+  powers_u[0] = powers_v[0] = 1;
+  for (int k = 1; k <= max_degree; k++) {
+    powers_u[k] = powers_u[k - 1] * (x - anchor_x);
+    powers_v[k] = powers_v[k - 1] * (y - anchor_y);
+  }
+  for (int a = 0; a <= max_degree; a++) {
+    for (int b = 0; a + b <= max_degree; b++) {
+      moments[a][b] += powers_u[a] * powers_v[b] * sign;
+    }
+  }
+}
+
+void IncrementalCubicFit::Rebuild() {
+  size_t n = window_x.size();
+  anchor_x = anchor_y = 0;
+  for (size_t i = 0; i < n; i++) {
+    anchor_x += window_x[i] / n;
+    anchor_y += window_y[i] / n;
+  }
+  for (int a = 0; a <= max_degree; a++) {
+    for (int b = 0; b <= max_degree; b++) {
+      moments[a][b] = 0;
+    }
+  }
+  for (size_t i = 0; i < n; i++) {
+    Accumulate(window_x[i], window_y[i], 1);
+  }
+  num_downdates = 0;
+}
+
+void IncrementalCubicFit::SetPoints(const vector<double> & xs, const vector<double> & ys) {
+  size_t n = std::min(xs.size(), ys.size());
+
+  // Match the new waypoints with the window's, each at most once. Usually the window has
+  // slid forward along the track: the new waypoints start at some waypoint of the window,
+  // and follow it to its end, which takes one pass. Otherwise, match them one by one.
+  kept.assign(window_x.size(), false);
+  joined.clear();
+  size_t shift = 0;
+  while (n > 0 && shift < window_x.size() &&
+         (window_x[shift] != xs[0] || window_y[shift] != ys[0])) {
+    shift++;
+  }
+  size_t overlap = std::min(n, window_x.size() - shift);
+  bool slid = overlap > 0;
+  for (size_t i = 0; i < overlap && slid; i++) {
+    slid = window_x[shift + i] == xs[i] && window_y[shift + i] == ys[i];
+  }
+  if (slid) {
+    std::fill(kept.begin() + shift, kept.begin() + shift + overlap, true);
+    for (size_t i = overlap; i < n; i++) {
+      joined.push_back(i);
+    }
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      size_t j = 0;
+      while (j < window_x.size() && (kept[j] || window_x[j] != xs[i] || window_y[j] != ys[i])) {
+        j++;
+      }
+      if (j < window_x.size()) {
+        kept[j] = true;
+      } else {
+        joined.push_back(i);
+      }
+    }
+  }
+
+  size_t num_kept = 0;
+  for (size_t j = 0; j < window_x.size(); j++) {
+    if (kept[j]) {
+      window_x[num_kept] = window_x[j];
+      window_y[num_kept] = window_y[j];
+      num_kept++;
+    } else {
+      Accumulate(window_x[j], window_y[j], -1);
+      num_downdates++;
+    }
+  }
+  window_x.resize(num_kept);
+  window_y.resize(num_kept);
+  for (size_t i : joined) {
+    window_x.push_back(xs[i]);
+    window_y.push_back(ys[i]);
+    if (num_kept > 0) {
+      Accumulate(xs[i], ys[i], 1);
+    }
+  }
+
+  // With no waypoint kept, the moments are about a stale anchor, if any.
+  if (num_kept == 0 || num_downdates >= rebuild_interval) {
+    Rebuild();
+    return;
+  }
+  // Rebuild once the anchor is farther from the centroid than the waypoints' spread.
+  double count = moments[0][0];
+  double centroid_u = moments[1][0] / count;
+  double centroid_v = moments[0][1] / count;
+  double centroid_squared = centroid_u * centroid_u + centroid_v * centroid_v;
+  double spread_squared = (moments[2][0] + moments[0][2]) / count - centroid_squared;
+  if (centroid_squared > spread_squared) {
+    Rebuild();
+  }
+}
+
+bool IncrementalCubicFit::Fit(double x, double y, double psi, Eigen::Vector4d & coeffs) const {
+  size_t n = window_x.size();
+  if (n < 4) {
+    return false;
+  }
+
+  // Translate: the moments about the car, of (u, v) = (u_anchor - dx, v_anchor - dy).
+  double dx = x - anchor_x;
+  double dy = y - anchor_y;
+  double powers_dx[max_degree + 1];
+  double powers_dy[max_degree + 1];
+  powers_dx[0] = powers_dy[0] = 1;
+  for (int k = 1; k <= max_degree; k++) {
+    powers_dx[k] = powers_dx[k - 1] * -dx;
+    powers_dy[k] = powers_dy[k - 1] * -dy;
+  }
+  // One axis at a time: shift u, then v.
+  double shifted_u[max_degree + 1][max_degree + 1];
+  for (int a = 0; a <= max_degree; a++) {
+    for (int b = 0; a + b <= max_degree; b++) {
+      double sum = 0;
+      for (int i = 0; i <= a; i++) {
+        sum += binomial[a][i] * powers_dx[a - i] * moments[i][b];
+      }
+      shifted_u[a][b] = sum;
+    }
+  }
+  double about_car[max_degree + 1][max_degree + 1];
+  for (int a = 0; a <= max_degree; a++) {
+    for (int b = 0; a + b <= max_degree; b++) {
+      double sum = 0;
+      for (int j = 0; j <= b; j++) {
+        sum += binomial[b][j] * powers_dy[b - j] * shifted_u[a][j];
+      }
+      about_car[a][b] = sum;
+    }
+  }
+
+  // Rotate: with car coordinates x' = c u + s v and y' = -s u + c v, the normal equations
+  // need sum(x'^k), k <= 6, and sum(y' x'^k), k <= 3.
+  double c = cos(psi);
+  double s = sin(psi);
+  double powers_c[max_degree + 1];
+  double powers_s[max_degree + 1];
+  powers_c[0] = powers_s[0] = 1;
+  for (int k = 1; k <= max_degree; k++) {
+    powers_c[k] = powers_c[k - 1] * c;
+    powers_s[k] = powers_s[k - 1] * s;
+  }
+  double power_sums[max_degree + 1];
+  double cross_sums[4];
+  for (int k = 0; k <= max_degree; k++) {
+    power_sums[k] = 0;
+    if (k < 4) {
+      cross_sums[k] = 0;
+    }
+    for (int j = 0; j <= k; j++) {
+      double term = binomial[k][j] * powers_c[j] * powers_s[k - j];
+      power_sums[k] += term * about_car[j][k - j];
+      if (k < 4) {
+        cross_sums[k] += term * (c * about_car[j][k - j + 1] - s * about_car[j + 1][k - j]);
+      }
+    }
+  }
+
+  // Solve as `fit_cubic` does, with x' scaled by its root mean square.
+  double scale = sqrt(power_sums[2] / n);
+  bool solved = false;
+  if (scale > 0) {
+    double powers_scale[max_degree + 1];
+    powers_scale[0] = 1;
+    for (int k = 1; k <= max_degree; k++) {
+      powers_scale[k] = powers_scale[k - 1] / scale;
+    }
+    Eigen::Matrix4d normal;
+    Eigen::Vector4d moments_y;
+    for (int r = 0; r < 4; r++) {
+      for (int col = 0; col < 4; col++) {
+        normal(r, col) = power_sums[r + col] * powers_scale[r + col];
+      }
+      moments_y[r] = cross_sums[r] * powers_scale[r];
+    }
+    Eigen::LLT<Eigen::Matrix4d> llt(normal);
+    if (llt.info() == Eigen::Success) {
+      Eigen::Vector4d diagonal = llt.matrixLLT().diagonal();
+      double ratio = diagonal.minCoeff() / diagonal.maxCoeff();
+      if (ratio * ratio >= 1e-10) {
+        coeffs = llt.solve(moments_y);
+        for (int k = 1; k < 4; k++) {
+          coeffs[k] *= powers_scale[k];
+        }
+        solved = true;
+      }
+    }
+  }
+  if (!solved) {
+    // Ill-conditioned: fit the transformed waypoints, by QR if need be.
+    vector<double> car_x(n), car_y(n);
+    for (size_t i = 0; i < n; i++) {
+      double u = window_x[i] - x;
+      double v = window_y[i] - y;
+      car_x[i] = c * u + s * v;
+      car_y[i] = -s * u + c * v;
+    }
+    return fit_cubic(car_x.data(), car_y.data(), n, coeffs);
+  }
+  return true;
+}
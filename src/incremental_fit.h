@@ -0,0 +1,57 @@
+#ifndef INCREMENTAL_FIT_H
+#define INCREMENTAL_FIT_H
+
+#include <cstddef>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+
+// Fits the reference cubic of consecutive telemetry events incrementally, in the global
+// coordinate system, where consecutive events share most of their waypoints.
+//
+// A cubic in the car's coordinate system is not a cubic in the global one, so rather than
+// a fit, the information it needs is maintained: the moments sum(u^a v^b), a + b <= 6,
+// of the waypoints (u, v) relative to an anchor point. A waypoint joining or leaving the
+// window is a rank one update or downdate of them. The normal equations of the car's
+// cubic are moments of the car's coordinates, which are polynomials in u and v, so they
+// follow from the anchor's moments by an exact change of basis: a binomial translation
+// to the car's position, then a rotation to its heading.
+//
+// The moments are recomputed from the window, about a new anchor, when the window has
+// moved away from the anchor, which would cost precision, and after every few downdates,
+// which accumulate rounding.
+class IncrementalCubicFit {
+ public:
+  IncrementalCubicFit();
+
+  // Make the window the given waypoints, in the global coordinate system. Waypoints equal
+  // to ones in the window are kept, others are downdated and updated.
+  void SetPoints(const std::vector<double> & xs, const std::vector<double> & ys);
+
+  // The cubic through the window, as `fit_cubic` would fit it in the coordinate system of
+  // a car at (x, y) with heading `psi`. Return false if there are fewer than 4 waypoints.
+  bool Fit(double x, double y, double psi, Eigen::Vector4d & coeffs) const;
+
+  size_t size() const { return window_x.size(); }
+
+ private:
+  static const int max_degree = 6;
+
+  // Add a waypoint's terms to the moments, or subtract them if `sign` is negative.
+  void Accumulate(double x, double y, double sign);
+
+  // Recompute the moments about the centroid of the window.
+  void Rebuild();
+
+  std::vector<double> window_x;
+  std::vector<double> window_y;
+  double anchor_x;
+  double anchor_y;
+  double moments[max_degree + 1][max_degree + 1]; // moments[a][b] for a + b <= max_degree
+  size_t num_downdates; // since the last rebuild
+
+  // Scratch space of `SetPoints`.
+  std::vector<bool> kept;
+  std::vector<size_t> joined;
+};
+
+#endif /* INCREMENTAL_FIT_H */
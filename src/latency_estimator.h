@@ -0,0 +1,63 @@
+#ifndef LATENCY_ESTIMATOR_H
+#define LATENCY_ESTIMATOR_H
+
+#include <algorithm>
+#include <array>
+#include <mutex>
+
+// Online estimate of the latency from receiving telemetry to sending the actuation.
+//
+// Keeps an exponentially weighted moving average, and the most recent samples for
+// quantiles. Thread safe, so that the thread that sends can record while the thread
+// that solves reads.
+class LatencyEstimator {
+ public:
+  static const size_t window = 128;
+
+  // `alpha` is the weight of each new sample in the moving average.
+  explicit LatencyEstimator(double alpha = 0.1) : alpha_(alpha), count_(0), ewma_(0) {}
+
+  void Record(double seconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ewma_ = count_ == 0 ? seconds : alpha_ * seconds + (1 - alpha_) * ewma_;
+    recent_[count_ % window] = seconds;
+    count_++;
+  }
+
+  bool empty() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return count_ == 0;
+  }
+
+  // The moving average. Zero if empty.
+  double mean() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ewma_;
+  }
+
+  // The `q`-quantile, in [0, 1], of the recent samples. Zero if empty.
+  double quantile(double q) const {
+    std::array<double, window> sorted;
+    size_t n;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      n = std::min(count_, window);
+      std::copy(recent_.begin(), recent_.begin() + n, sorted.begin());
+    }
+    if (n == 0) {
+      return 0;
+    }
+    size_t k = std::min(n - 1, (size_t) (q * n));
+    std::nth_element(sorted.begin(), sorted.begin() + k, sorted.begin() + n);
+    return sorted[k];
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  const double alpha_;
+  size_t count_;
+  double ewma_;
+  std::array<double, window> recent_;
+};
+
+#endif /* LATENCY_ESTIMATOR_H */
@@ -0,0 +1,70 @@
+#include "latency_histogram.h"
+#include <math.h>
+#include <algorithm>
+
+const int LatencyHistogram::sub_bucket_bits;
+const uint64_t LatencyHistogram::sub_buckets;
+const int LatencyHistogram::max_bits;
+const uint64_t LatencyHistogram::max_ns;
+const size_t LatencyHistogram::num_buckets;
+
+uint64_t LatencyHistogram::HighestInBucket(size_t index) {
+  if (index < sub_buckets) {
+    return index;
+  }
+  int shift = index / (sub_buckets / 2) - 1;
+  uint64_t sub_bucket = index - shift * (sub_buckets / 2);
+  return ((sub_bucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Add(const LatencyHistogram & other) {
+  for (size_t i = 0; i < num_buckets; i++) {
+    uint64_t count = other.counts[i].load(std::memory_order_relaxed);
+    if (count > 0) {
+      counts[i].fetch_add(count, std::memory_order_relaxed);
+    }
+  }
+  total_count.fetch_add(other.count(), std::memory_order_relaxed);
+  total_ns.fetch_add(other.total_ns.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  uint64_t other_max = other.max_seen.load(std::memory_order_relaxed);
+  uint64_t max = max_seen.load(std::memory_order_relaxed);
+  while (other_max > max &&
+         !max_seen.compare_exchange_weak(max, other_max, std::memory_order_relaxed)) {}
+}
+
+void LatencyHistogram::Reset() {
+  for (size_t i = 0; i < num_buckets; i++) {
+    counts[i].store(0, std::memory_order_relaxed);
+  }
+  total_count.store(0, std::memory_order_relaxed);
+  total_ns.store(0, std::memory_order_relaxed);
+  max_seen.store(0, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::mean() const {
+  uint64_t n = count();
+  return n == 0 ? 0 : total_ns.load(std::memory_order_relaxed) * 1e-9 / n;
+}
+
+double LatencyHistogram::quantile(double q) const {
+  // Count the buckets themselves, rather than trust `total_count`, which a concurrent
+  // recording may have reached first.
+  uint64_t n = 0;
+  for (size_t i = 0; i < num_buckets; i++) {
+    n += counts[i].load(std::memory_order_relaxed);
+  }
+  if (n == 0) {
+    return 0;
+  }
+  uint64_t rank = std::max<uint64_t>(1, (uint64_t) ceil(std::min(1.0, std::max(0.0, q)) * n));
+  uint64_t seen = 0;
+  size_t i = 0;
+  for (; i + 1 < num_buckets; i++) {
+    seen += counts[i].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      break;
+    }
+  }
+  // No sample exceeds the largest one seen, however wide its bucket.
+  return std::min(HighestInBucket(i), max_seen.load(std::memory_order_relaxed)) * 1e-9;
+}
@@ -0,0 +1,79 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// A histogram of durations with a bounded relative error, after HdrHistogram.
+//
+// Durations are counted in nanoseconds, in buckets that double in width with each power
+// of two, each split into `sub_buckets / 2` equal sub-buckets, so that a duration is
+// reported to within 1/64 of itself, from 1 ns to `max_ns` (about 69 s). Longer ones are
+// counted as `max_ns`. Recording is lock-free and wait-free, so that any thread may
+// record while any other reads; a reader sees each count as of some recent time.
+class LatencyHistogram {
+ public:
+  static const int sub_bucket_bits = 7;
+  static const uint64_t sub_buckets = 1 << sub_bucket_bits;
+  static const int max_bits = 36;
+  static const uint64_t max_ns = (uint64_t(1) << max_bits) - 1;
+  static const size_t num_buckets = sub_buckets + (max_bits - sub_bucket_bits) * (sub_buckets / 2);
+
+  LatencyHistogram() { Reset(); }
+
+  LatencyHistogram(const LatencyHistogram &) = delete;
+  LatencyHistogram & operator=(const LatencyHistogram &) = delete;
+
+  void Record(double seconds) {
+    uint64_t ns = seconds > 0 ? (uint64_t) (seconds * 1e9 + 0.5) : 0;
+    RecordNanoseconds(ns);
+  }
+
+  void RecordNanoseconds(uint64_t ns) {
+    if (ns > max_ns) {
+      ns = max_ns;
+    }
+    counts[Index(ns)].fetch_add(1, std::memory_order_relaxed);
+    total_count.fetch_add(1, std::memory_order_relaxed);
+    total_ns.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t max = max_seen.load(std::memory_order_relaxed);
+    while (ns > max && !max_seen.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+  }
+
+  // Add the counts of `other` to these.
+  void Add(const LatencyHistogram & other);
+
+  // Not atomic with respect to concurrent recording: samples recorded meanwhile may be
+  // partly kept.
+  void Reset();
+
+  uint64_t count() const { return total_count.load(std::memory_order_relaxed); }
+
+  // In seconds, or zero if empty.
+  double mean() const;
+  double max() const { return max_seen.load(std::memory_order_relaxed) * 1e-9; }
+
+  // The smallest duration, in seconds, that at least the fraction `q` of the samples do
+  // not exceed, to within the precision of the buckets, or zero if empty.
+  double quantile(double q) const;
+
+  // The bucket of a duration, and the largest duration in a bucket.
+  static size_t Index(uint64_t ns) {
+    if (ns < sub_buckets) {
+      return ns;
+    }
+    // Keep the top `sub_bucket_bits` bits of the duration.
+    int shift = 63 - __builtin_clzll(ns) - (sub_bucket_bits - 1);
+    return (shift << (sub_bucket_bits - 1)) + (ns >> shift);
+  }
+  static uint64_t HighestInBucket(size_t index);
+
+ private:
+  std::atomic<uint64_t> counts[num_buckets];
+  std::atomic<uint64_t> total_count;
+  std::atomic<uint64_t> total_ns;
+  std::atomic<uint64_t> max_seen;
+};
+
+#endif /* LATENCY_HISTOGRAM_H */
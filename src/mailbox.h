@@ -0,0 +1,151 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+
+// A telemetry event as received, before parsing.
+struct TelemetryFrame {
+  std::string data;
+  // Whether `data` is in the binary wire format, else it is the JSON of a socket.io event.
+  bool binary;
+  std::chrono::steady_clock::time_point received;
+};
+
+// Telemetry frames of one connection, waiting to be solved.
+//
+// The event loop offers every frame it receives, and a solver job takes them one
+// at a time. The mailbox also tracks whether a solver job is scheduled for it, so
+// that the frames of one connection are never solved concurrently.
+//
+// When no frame is pending, a speculation job may be scheduled instead. Until it starts,
+// a frame that arrives schedules a solver job, which the speculation job then yields to.
+//
+// In conflation mode, the mailbox holds at most one frame. A frame that arrives
+// while the previous one is still pending replaces it, so that the solver always
+// works on the freshest state instead of on a backlog of outdated ones.
+class TelemetryMailbox {
+ public:
+  typedef std::chrono::steady_clock clock;
+
+  explicit TelemetryMailbox(bool conflate) :
+    conflate_(conflate), state_(idle), closed_(false), superseded_(0) {}
+
+  // Store a frame.
+  // Return true if no solver job is scheduled, in which case the caller must schedule one.
+  bool Offer(TelemetryFrame frame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) {
+      return false;
+    }
+    if (conflate_ && !pending_.empty()) {
+      superseded_ += pending_.size();
+      pending_.clear();
+    }
+    pending_.push_back(std::move(frame));
+    if (state_ == solving || state_ == speculating) {
+      return false;
+    }
+    state_ = solving;
+    return true;
+  }
+
+  // Move out the oldest pending frame.
+  // If there is none, mark the solver job as finished and return false.
+  bool Take(TelemetryFrame & frame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_.empty() || closed_) {
+      state_ = idle;
+      return false;
+    }
+    frame = std::move(pending_.front());
+    pending_.pop_front();
+    return true;
+  }
+
+  // Instead of taking the next frame, hand over to a speculation job, if no frame is
+  // pending. Return true if the caller must schedule one.
+  bool ScheduleSpeculation() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!pending_.empty() || closed_) {
+      return false;
+    }
+    state_ = speculation_queued;
+    return true;
+  }
+
+  // Return true if the speculation job may run, i.e. no frame has arrived since it was
+  // scheduled. It must then call `FinishSpeculation` once done.
+  bool StartSpeculation() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ != speculation_queued) {
+      return false;
+    }
+    if (closed_) {
+      state_ = idle;
+      return false;
+    }
+    state_ = speculating;
+    return true;
+  }
+
+  // Return true if frames arrived while speculating, in which case the caller must
+  // schedule a solver job.
+  bool FinishSpeculation() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_.empty() || closed_) {
+      state_ = idle;
+      return false;
+    }
+    state_ = solving;
+    return true;
+  }
+
+  // When the oldest pending frame arrived, i.e. the one `Take` would return next.
+  // Return false if there is no pending frame.
+  bool NextReceived(clock::time_point & received) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_.empty()) {
+      return false;
+    }
+    received = pending_.front().received;
+    return true;
+  }
+
+  // How much later than `received` the newest pending frame arrived.
+  // Zero if there is no pending frame.
+  clock::duration PendingLead(clock::time_point received) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_.empty()) {
+      return clock::duration::zero();
+    }
+    return pending_.back().received - received;
+  }
+
+  // Discard pending frames, and ignore frames offered from now on.
+  void Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    pending_.clear();
+  }
+
+  // Number of frames that were discarded by conflation.
+  size_t superseded() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return superseded_;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  const bool conflate_;
+  std::deque<TelemetryFrame> pending_;
+  // Which job, if any, is scheduled or running.
+  enum { idle, solving, speculation_queued, speculating } state_;
+  bool closed_;
+  size_t superseded_;
+};
+
+#endif /* MAILBOX_H */
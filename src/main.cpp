@@ -1,24 +1,25 @@
 #include <math.h>
+#include <signal.h>
 #include <uWS/uWS.h>
 #include <chrono>
+#include <functional>
 #include <iostream>
-#include <list>
+#include <memory>
 #include <thread>
-#include <tuple>
 #include <vector>
-#include "Eigen-3.3/Eigen/Core"
-#include "Eigen-3.3/Eigen/Dense"
-#include "Eigen-3.3/Eigen/QR"
 #include "MPC.h"
-#include "json.hpp"
-#include "tools.h"
+#include "actuation_stream.h"
+#include "controller.h"
+#include "outbox.h"
+#include "pipeline_stats.h"
+#include "session.h"
+#include "shm_transport.h"
+#include "solver_pool.h"
+#include "telemetry_log.h"
+#include "wire.h"
 
-using std::list;
 using std::string;
 using std::vector;
-using Eigen::MatrixXd;
-using Eigen::VectorXd;
-using json = nlohmann::json;
 
 // Checks if the SocketIO event has JSON data.
 // If there is data the JSON object in string format will be returned,
@@ -35,69 +36,233 @@ string hasData(const string & s) {
   return "";
 }
 
-// Fit a polynomial.
-// Adapted from
-// https://github.com/JuliaMath/Polynomials.jl/blob/master/src/Polynomials.jl#L676-L716
-Eigen::VectorXd polyfit(const Eigen::VectorXd & xvals, const Eigen::VectorXd & yvals,
-                        int order) {
-  assert(xvals.size() == yvals.size());
-  assert(order >= 1 && order <= xvals.size() - 1);
-  Eigen::MatrixXd A(xvals.size(), order + 1);
-
-  for (int i = 0; i < xvals.size(); i++) {
-    A(i, 0) = 1.0;
-  }
+// The wall time since `start`, in seconds.
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Command line options.
+struct ServerOptions {
+  ControllerOptions controller;
+  // In conflation mode, only the newest pending telemetry of each connection is solved.
+  bool conflate = false;
+  // If positive, discard a solve whose telemetry is older than the newest pending
+  // telemetry by more than this many milliseconds.
+  int cancel_gap_ms = 0;
+  int port = 4567;
+  // Number of threads solving for all connections.
+  size_t num_workers = 1;
+  // Number of event loop threads accepting and serving connections.
+  size_t num_listeners = 1;
+  // If not empty, localize vehicles on the track map built from this waypoint file,
+  // or mapped from this compiled map file.
+  string track_map_path;
+  // If not empty, load the map's target speeds from this file. Requires a track map.
+  string speed_profile_path;
+  // If not empty, also serve one vehicle over the shared memory channel of this name.
+  string shm_name;
+  // If positive, also stream interpolated actuations over the shared memory channel
+  // at this rate.
+  double actuation_rate_hz = 0;
+  // If not empty, record the telemetry of all connections to this log, and the recorder
+  // writing it.
+  string record_path;
+  TelemetryRecorder *recorder = nullptr;
+};
 
-  for (int j = 0; j < xvals.size(); j++) {
-    for (int i = 0; i < order; i++) {
-      A(j, i + 1) = A(j, i) * xvals(j);
+void submit_solve(std::shared_ptr<Session> session, SolverPool & pool,
+                  const ServerOptions & options);
+void speculate_next(std::shared_ptr<Session> session, SolverPool & pool,
+                    const ServerOptions & options);
+
+// Solve one pending telemetry frame of the session, and post the reply.
+// Then resubmit itself for the next pending frame, so that sessions take turns on the pool.
+void solve_next(std::shared_ptr<Session> session, SolverPool & pool,
+                const ServerOptions & options) {
+  TelemetryFrame frame;
+  if (!session->mailbox.Take(frame)) {
+    return;
+  }
+  auto received = frame.received;
+  session->stats.Record(stage_queue, seconds_since(received));
+
+  int cancel_gap_ms = options.cancel_gap_ms;
+  int cancel_polls = 0;
+  auto should_cancel = [&session, &received, cancel_gap_ms, &cancel_polls]() {
+    cancel_polls++;
+    return cancel_gap_ms > 0 &&
+      session->mailbox.PendingLead(received) > std::chrono::milliseconds(cancel_gap_ms);
+  };
+
+  auto parse_start = std::chrono::steady_clock::now();
+  Telemetry telemetry;
+  if (frame.binary) {
+    if (!decode_telemetry(frame.data.data(), frame.data.length(), telemetry)) {
+      std::cerr << "Malformed binary telemetry" << std::endl;
+      submit_solve(session, pool, options);
+      return;
+    }
+  } else {
+    parse_telemetry_json(frame.data, telemetry);
+  }
+  session->stats.Record(stage_parse, seconds_since(parse_start));
+
+  Actuation actuation;
+  bool solved = session->controller.Control(telemetry, should_cancel, actuation);
+  session->stats.RecordControl(session->controller.timings());
+  if (solved) {
+    auto serialize_start = std::chrono::steady_clock::now();
+    string msg;
+    uWS::OpCode op_code;
+    if (frame.binary) {
+      encode_steer(actuation, msg);
+      op_code = uWS::OpCode::BINARY;
+    } else {
+      msg = format_steer_json(actuation);
+      op_code = uWS::OpCode::TEXT;
     }
+    session->stats.Record(stage_serialize, seconds_since(serialize_start));
+
+    // Latency
+    // The purpose is to mimic real driving conditions where
+    // the car does actuate the commands instantly.
+    //
+    // Feel free to play around with this value but should be to drive
+    // around the track with 100ms latency.
+    //
+    // NOTE: REMEMBER TO SET THIS TO 100 MILLISECONDS BEFORE
+    // SUBMITTING.
+    auto due = Outbox::clock::now() + std::chrono::milliseconds(options.controller.actuation_delay_ms);
+    TelemetryRecorder *recorder = options.recorder;
+    session->outbox->Post(due, [session, msg, op_code, received, recorder]() {
+      if (!session->closed) {
+        auto send_start = std::chrono::steady_clock::now();
+        session->ws.send(msg.data(), msg.length(), op_code);
+        auto sent = TelemetryMailbox::clock::now();
+        session->stats.Record(stage_send, std::chrono::duration<double>(sent - send_start).count());
+        double latency = std::chrono::duration<double>(sent - received).count();
+        session->controller.RecordLatency(latency);
+        if (recorder != nullptr) {
+          TelemetryLogRecord record = TelemetryLogRecord();
+          record.type = record_latency;
+          record.session = session->id;
+          record.time = to_log_time(sent);
+          record.latency = latency;
+          recorder->Append(record);
+        }
+      }
+    });
+  } else {
+    session->cancelled++;
   }
 
-  auto Q = A.householderQr();
-  auto result = Q.solve(yvals);
-  return result;
-}
+  // Account for the deadline before speculating, which does not delay this reply.
+  if (SolverPool::clock::now() > received + std::chrono::milliseconds(options.controller.actuation_delay_ms)) {
+    session->deadline_misses++;
+  }
 
-enum actuation_delay_strategy {
-  one,
-  avg,
-  iterative
-};
+  if (options.recorder != nullptr) {
+    const ControlTimings & timings = session->controller.timings();
+    TelemetryLogRecord record = TelemetryLogRecord();
+    record.type = record_telemetry;
+    record.session = session->id;
+    record.time = to_log_time(received);
+    record.data_size = frame.data.size();
+    record.binary = frame.binary;
+    record.solved = solved;
+    record.cancel_polls = solved ? 0 : cancel_polls;
+    record.control_start = to_log_time(timings.received);
+    record.committed = to_log_time(timings.committed);
+    record.steering_angle = actuation.steering_angle;
+    record.throttle = actuation.throttle;
+    options.recorder->Append(record, frame.data.data());
+  }
 
-int main(int argc, char* argv[]) {
-  actuation_delay_strategy strategy;
-  if (argc >= 2 && strcmp(argv[1], "avg") == 0) {
-    strategy = avg;
-  } else if (argc >= 2 && strcmp(argv[1], "iterative") == 0) {
-    strategy = iterative;
-  } else {
-    strategy = one;
+  // While no newer telemetry is pending, solve ahead for the telemetry expected next,
+  // at the lowest priority, so that any frame waiting for a solver goes first.
+  if (options.controller.speculate && session->mailbox.ScheduleSpeculation()) {
+    pool.Submit(SolverPool::clock::time_point::max(), [session, &pool, &options]() {
+      speculate_next(session, pool, options);
+    });
+    return;
   }
 
-  uWS::Hub h;
+  submit_solve(session, pool, options);
+}
 
-  // MPC is initialized here!
-  MPC mpc;
+// Solve ahead for the session's next telemetry, unless a frame has arrived since this
+// job was scheduled. Then schedule the frames that arrived meanwhile, if any.
+void speculate_next(std::shared_ptr<Session> session, SolverPool & pool,
+                    const ServerOptions & options) {
+  if (!session->mailbox.StartSpeculation()) {
+    return;
+  }
+  if (options.recorder != nullptr) {
+    TelemetryLogRecord record = TelemetryLogRecord();
+    record.type = record_speculation;
+    record.session = session->id;
+    record.time = to_log_time(SolverPool::clock::now());
+    options.recorder->Append(record);
+  }
+  session->controller.Speculate();
+  if (session->mailbox.FinishSpeculation()) {
+    submit_solve(session, pool, options);
+  }
+}
+
+// Schedule the session's next pending frame, due by its arrival plus the actuation delay.
+void submit_solve(std::shared_ptr<Session> session, SolverPool & pool,
+                  const ServerOptions & options) {
+  // If nothing is pending, the job only marks the session as idle; do it right away.
+  auto deadline = SolverPool::clock::now();
+  if (session->mailbox.NextReceived(deadline)) {
+    deadline += std::chrono::milliseconds(options.controller.actuation_delay_ms);
+  }
+  pool.Submit(deadline, [session, &pool, &options]() {
+    solve_next(session, pool, options);
+  });
+}
 
-  int actuation_delay_ms = 100;
-  double actuation_delay_s = actuation_delay_ms / 1000.0;
+// Print the time spent in each stage of the pipeline, by open session and in total.
+void print_pipeline_stats(const SessionRegistry & registry, std::ostream & out) {
+  for (const auto & session : registry.Open()) {
+    out << "Session " << session->id << ":" << std::endl;
+    session->stats.Print(out);
+  }
+  std::unique_ptr<PipelineStats> total(new PipelineStats());
+  registry.Total(*total);
+  out << "All sessions:" << std::endl;
+  total->Print(out);
+}
 
-  // In the simulation, vehicle starts with 0 steering and 0 throttle.
-  double last_steering = 0;
-  double last_throttle = 0;
+// Run one event loop, serving the connections it accepts. Return only if it fails to listen.
+//
+// With several event loops, each listens on the same port with SO_REUSEPORT, and the
+// kernel spreads incoming connections across them.
+int run_hub(const ServerOptions & options, SolverPool & pool, SessionRegistry & registry) {
+  uWS::Hub h;
 
-  // List of tuples of (steering, throttle, timestamp).
-  // Newer items will be pushed to the front, not back.
-  list<std::tuple<double, double, std::time_t>> actuation_history =
-    {std::make_tuple(last_steering, last_throttle, std::time(0))};
+  Outbox outbox(h.getLoop());
 
   h.onMessage(
-    [&mpc, &actuation_delay_ms, &actuation_delay_s,
-      &strategy,
-      &last_steering, &last_throttle,
-      &actuation_history]
+    [&pool, &options]
     (uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
+    auto received = TelemetryMailbox::clock::now();
+
+    // Binary frames are telemetry in the compact wire format. See wire.h.
+    // Defer decoding to the solver, so that superseded frames are never decoded.
+    if (opCode == uWS::OpCode::BINARY) {
+      if (is_binary_message(data, length)) {
+        auto session = *static_cast<std::shared_ptr<Session> *>(ws.getUserData());
+        TelemetryFrame frame {string(data, length), true, received};
+        session->stats.Record(stage_frame, seconds_since(received));
+        if (session->mailbox.Offer(std::move(frame))) {
+          submit_solve(session, pool, options);
+        }
+      }
+      return;
+    }
+
     // "42" at the start of the message means there's a websocket message event.
     // The 4 signifies a websocket message
     // The 2 signifies a websocket event
@@ -105,167 +270,13 @@ int main(int argc, char* argv[]) {
     if (sdata.size() > 2 && sdata[0] == '4' && sdata[1] == '2') {
       string s = hasData(sdata);
       if (s != "") {
-        auto j = json::parse(s);
-        string event = j[0].get<string>();
-        if (event == "telemetry") {
-          // j[1] is the data JSON object
-          vector<double> ptsx = j[1]["ptsx"];
-          vector<double> ptsy = j[1]["ptsy"];
-          double px = j[1]["x"];
-          double py = j[1]["y"];
-          double psi = j[1]["psi"]; // radian
-          double v = j[1]["speed"]; // mile/hour
-          v /= mps_to_mph; // meter/sec
-
-          // transform the global coordinate to car's coordinate system
-          MatrixXd pts_wrt_car = translate_then_rotate(ptsx, ptsy, -px, -py, -psi);
-          VectorXd ptsx_wrt_car = pts_wrt_car.row(0);
-          VectorXd ptsy_wrt_car = pts_wrt_car.row(1);
-
-          VectorXd coeffs = polyfit(ptsx_wrt_car, ptsy_wrt_car, 3);
-
-          // Update and add state vars in the car's coordinate system
-          px = py = psi = 0;
-          double cte = coeffs[0];
-          double epsi = -atan(coeffs[1]);
-
-          // Now, determine the init state to pass to the solver.
-
-          double aggregated_steering = 0; // used by `one` and `avg` strategies only
-          double aggregated_throttle = 0; // ditto
-
-          auto history_iter = actuation_history.begin(); // used by `avg` and `iterative` strategies only
-          auto history_purge_iter = history_iter; // ditto
-
-          std::time_t now = std::time(0);
-
-          if (strategy == one) {
-            aggregated_steering = last_steering;
-            aggregated_throttle = last_throttle;
-          } else {
-            int actuation_i = 0;
-            double aggregated_steering = 0;
-            double aggregated_throttle = 0;
-
-            // Determine the newest actuation that is older than the actuation delay.
-            // If there is none older than the actuation delay, then choose the oldest in history.
-            for(; history_iter != actuation_history.end(); history_iter++) {
-              double steering, throttle;
-              std::time_t ts;
-              std::tie(steering, throttle, ts) = *history_iter;
-
-              actuation_i++;
-              aggregated_steering += steering;
-              aggregated_throttle += throttle;
-
-              double age = std::difftime(now, ts); // how long ago from the present this actuation was
-              if (age > actuation_delay_s) {
-                break;
-              }
-            }
-            if (history_iter == actuation_history.end()) {
-              // Business logic guarantees the list has at least one item, so this is safe.
-              std::advance(history_iter, -1);
-            }
-
-            // save for purging, to be done later
-            history_purge_iter = history_iter;
-
-            if (strategy == avg) {
-              aggregated_steering /= actuation_i;
-              aggregated_throttle /= actuation_i;
-            }
+        // Defer parsing to the solver, so that superseded frames are never parsed.
+        if (s.compare(0, 12, "[\"telemetry\"") == 0) {
+          auto session = *static_cast<std::shared_ptr<Session> *>(ws.getUserData());
+          session->stats.Record(stage_frame, seconds_since(received));
+          if (session->mailbox.Offer(TelemetryFrame {std::move(s), false, received})) {
+            submit_solve(session, pool, options);
           }
-
-          vector<double> init_state; // the init state to the pass to the solver.
-
-          if (strategy == one || strategy == avg) {
-            // helpers for the global kinetic model below. cos and sin are simplified away.
-            double delayed_x_term = v /** cos(psi)*/ * actuation_delay_s;
-            double delayed_y_term = 0; // v * sin(psi) * actuation_delay_s;
-            double delayed_psi_term = v / Lf * aggregated_steering * actuation_delay_s;
-
-            // global kinetic model for the actuation delay
-            double px_delayed = px + delayed_x_term;
-            double py_delayed = py + delayed_y_term;
-            double psi_delayed = psi + delayed_psi_term;
-            double v_delayed = v + aggregated_throttle * actuation_delay_s;
-            double cte_delayed = cte + delayed_y_term;
-            double epsi_delayed = epsi + delayed_psi_term;
-
-            init_state = {px_delayed, py_delayed, psi_delayed, v_delayed, cte_delayed, epsi_delayed};
-          } else {
-            init_state = {px, py, psi, v, cte, epsi};
-
-            // Iteratively update the states using global kinetic model to estimate
-            // what the state will likely look like after actuation delay from the present.
-            for(; history_iter != actuation_history.begin(); history_iter--) {
-              double steering, throttle;
-              std::time_t earlier_ts;
-              std::tie(steering, throttle, earlier_ts) = *history_iter;
-
-              double earlier_age = std::difftime(now, earlier_ts);
-              earlier_age = std::min(earlier_age, actuation_delay_s); // cap by actuation delay
-
-              double later_age;
-              if (history_iter == actuation_history.begin()) {
-                later_age = 0;
-              } else {
-                double _0, _1;
-                std::time_t later_ts;
-                std::tie(_0, _1, later_ts) = *(std::prev(history_iter, 1));
-                later_age = std::difftime(now, later_ts);
-              }
-
-              double dt = earlier_age - later_age;
-
-              init_state = global_kinetic_model(init_state, steering, throttle, dt, Lf);
-            }
-          }
-
-          // Calculate steering angle and throttle using MPC.
-          vector<double> mpc_x, mpc_y;
-          std::tie(last_steering, last_throttle, mpc_x, mpc_y) = mpc.Solve(init_state, coeffs);
-
-          json msgJson;
-          msgJson["steering_angle"] = -last_steering; // udacity simulator takes positive values for right turn
-          msgJson["throttle"] = last_throttle;
-
-          //Display the MPC predicted trajectory. Displayed in green line.
-          msgJson["mpc_x"] = mpc_x;
-          msgJson["mpc_y"] = mpc_y;
-
-          //Display the waypoints/reference line.  Displayed in yellow line.
-          msgJson["next_x"] = eigen_to_std_vector(ptsx_wrt_car);
-          msgJson["next_y"] = eigen_to_std_vector(ptsy_wrt_car);
-
-          auto msg = "42[\"steer\"," + msgJson.dump() + "]";
-          
-          // capture the time of actuation (just before the artificically introduced latency)
-          now = std::time(0);
-
-          auto response_thread = std::thread([&ws, &msg, &actuation_delay_ms]() {
-            // Latency
-            // The purpose is to mimic real driving conditions where
-            // the car does actuate the commands instantly.
-            //
-            // Feel free to play around with this value but should be to drive
-            // around the track with 100ms latency.
-            //
-            // NOTE: REMEMBER TO SET THIS TO 100 MILLISECONDS BEFORE
-            // SUBMITTING.
-            std::this_thread::sleep_for(std::chrono::milliseconds(actuation_delay_ms));
-            ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
-          });
-
-          if (strategy == avg || strategy == iterative) {
-            // after actuation is executed, do cleanup
-            // Here we push_back an item, keeping the size of the list at least one.
-            actuation_history.push_front(std::make_tuple(last_steering, last_throttle, now));
-            actuation_history.erase(history_purge_iter, actuation_history.end());
-          }
-
-          response_thread.join();
         }
       } else {
         // Manual driving
@@ -289,22 +300,181 @@ int main(int argc, char* argv[]) {
     }
   });
 
-  h.onConnection([](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
+  h.onConnection(
+    [&options, &outbox, &registry]
+    (uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
+    static std::atomic<uint32_t> next_session_id(0);
+    auto session = std::make_shared<Session>(
+      next_session_id++, ws, &outbox, options.controller, options.conflate);
+    ws.setUserData(new std::shared_ptr<Session>(session));
+    registry.Add(session);
+    if (options.recorder != nullptr) {
+      TelemetryLogRecord record = TelemetryLogRecord();
+      record.type = record_open;
+      record.session = session->id;
+      record.time = to_log_time(session->controller.created());
+      options.recorder->Append(record);
+    }
     std::cout << "Connected!!!" << std::endl;
   });
 
-  h.onDisconnection([](uWS::WebSocket<uWS::SERVER> ws, int code,
-                         char *message, size_t length) {
+  h.onDisconnection([&registry](uWS::WebSocket<uWS::SERVER> ws, int code,
+                                 char *message, size_t length) {
+    auto session_ptr = static_cast<std::shared_ptr<Session> *>(ws.getUserData());
+    if (session_ptr != nullptr) {
+      auto session = *session_ptr;
+      delete session_ptr;
+      ws.setUserData(nullptr);
+
+      // A solve in progress may still complete, but its reply will be dropped.
+      session->closed = true;
+      session->mailbox.Close();
+      registry.Remove(*session);
+      auto & latency = session->controller.measured_latency();
+      std::cout << "Superseded " << session->mailbox.superseded()
+        << " and cancelled " << session->cancelled << " telemetry frames. "
+        << "Missed " << session->deadline_misses << " deadlines. "
+        << "Speculation hits " << session->controller.speculation_hits()
+        << ", misses " << session->controller.speculation_misses() << ". "
+        << "Latency mean " << latency.mean() << " s, p90 " << latency.quantile(0.9) << " s"
+        << std::endl;
+    }
     ws.close();
     std::cout << "Disconnected" << std::endl;
   });
 
-  int port = 4567;
-  if (h.listen(port)) {
-    std::cout << "Listening to port " << port << std::endl;
+  int listen_options = options.num_listeners > 1 ? uS::ListenOptions::REUSE_PORT : 0;
+  if (h.listen(options.port, nullptr, listen_options)) {
+    std::cout << "Listening to port " << options.port << std::endl;
   } else {
     std::cerr << "Failed to listen to port" << std::endl;
     return -1;
   }
   h.run();
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  ServerOptions options;
+  options.num_workers = std::max(1u, std::thread::hardware_concurrency());
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--conflate") == 0) {
+      options.conflate = true;
+    } else if (strcmp(argv[i], "--cancel-gap-ms") == 0 && i + 1 < argc) {
+      options.cancel_gap_ms = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+      options.num_workers = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--listeners") == 0 && i + 1 < argc) {
+      options.num_listeners = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+      options.shm_name = argv[++i];
+    } else if (strcmp(argv[i], "--track-map") == 0 && i + 1 < argc) {
+      options.track_map_path = argv[++i];
+    } else if (strcmp(argv[i], "--speed-profile") == 0 && i + 1 < argc) {
+      options.speed_profile_path = argv[++i];
+    } else if (strcmp(argv[i], "--actuation-rate-hz") == 0 && i + 1 < argc) {
+      options.actuation_rate_hz = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      options.record_path = argv[++i];
+    } else if (!options.controller.Parse(argc, argv, i)) {
+      std::cerr << "Unknown option " << argv[i] << std::endl;
+      return -1;
+    }
+  }
+
+  // Shared by all controllers, read only.
+  TrackMap track_map;
+  if (!options.track_map_path.empty()) {
+    if (!track_map.Load(options.track_map_path)) {
+      return -1;
+    }
+    if (!options.speed_profile_path.empty() && !track_map.LoadSpeeds(options.speed_profile_path)) {
+      return -1;
+    }
+    options.controller.track_map = &track_map;
+    std::cout << "Loaded a track map of " << track_map.length() << " m" << std::endl;
+  } else if (options.controller.frenet || !options.speed_profile_path.empty()) {
+    std::cerr << "--frenet and --speed-profile require --track-map" << std::endl;
+    return -1;
+  }
+
+  // SIGUSR1 prints the pipeline stats. Block it in all threads, which inherit the mask
+  // of this one, and wait for it on a thread of its own, where printing is safe.
+  sigset_t report_signals;
+  sigemptyset(&report_signals);
+  sigaddset(&report_signals, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &report_signals, nullptr);
+
+  TelemetryRecorder recorder;
+  if (!options.record_path.empty()) {
+    if (!recorder.Open(options.record_path, argc, argv)) {
+      return -1;
+    }
+    options.recorder = &recorder;
+    std::cout << "Recording telemetry to " << options.record_path << std::endl;
+  }
+
+  // The pool workers, and the shared memory server after them, solve concurrently.
+  MPC::SetupThreads(options.num_workers + 1);
+  SolverPool pool(options.num_workers, [](size_t thread_i) {
+    MPC::SetThreadNumber(thread_i + 1);
+  });
+
+  ShmChannel shm_channel;
+  std::atomic<bool> shm_stop(false);
+  std::thread shm_server;
+  if (!options.shm_name.empty()) {
+    if (!shm_channel.Open(options.shm_name, true)) {
+      return -1;
+    }
+    shm_server = std::thread([&options, &shm_channel, &shm_stop]() {
+      MPC::SetThreadNumber(options.num_workers + 1);
+      Controller controller(options.controller);
+      std::unique_ptr<ActuationStreamer> streamer;
+      if (options.actuation_rate_hz > 0) {
+        // Drop samples if the actuator does not keep up, rather than block the stream.
+        streamer.reset(new ActuationStreamer(options.actuation_rate_hz, [&shm_channel](
+            uint64_t seq, ActuationStreamer::clock::time_point time,
+            double steering, double throttle) {
+          int64_t time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            time.time_since_epoch()).count();
+          shm_channel.stream().TryPush(ActuationSample {seq, time_ns, steering, throttle});
+        }));
+      }
+      serve_shm(shm_channel, controller, options.conflate, streamer.get(), shm_stop);
+    });
+    std::cout << "Serving shared memory channel " << options.shm_name << std::endl;
+  }
+
+  SessionRegistry registry;
+  std::atomic<bool> reporter_stop(false);
+  std::thread reporter([&report_signals, &registry, &reporter_stop]() {
+    int signal;
+    while (sigwait(&report_signals, &signal) == 0 && !reporter_stop) {
+      print_pipeline_stats(registry, std::cout);
+    }
+  });
+
+  // The main thread runs one event loop, and the others run on their own threads.
+  vector<std::thread> listeners;
+  for (size_t i = 1; i < options.num_listeners; i++) {
+    listeners.emplace_back([&options, &pool, &registry]() {
+      if (run_hub(options, pool, registry) != 0) {
+        exit(-1);
+      }
+    });
+  }
+  int ret = run_hub(options, pool, registry);
+  for (auto & listener : listeners) {
+    listener.join();
+  }
+  if (shm_server.joinable()) {
+    shm_stop = true;
+    shm_server.join();
+  }
+  reporter_stop = true;
+  pthread_kill(reporter.native_handle(), SIGUSR1);
+  reporter.join();
+  return ret;
 }
@@ -0,0 +1,59 @@
+// Compiles a waypoint file into a track map file, which `./mpc --track-map` maps at
+// startup instead of fitting the waypoints. See track_map_file.h.
+//
+// The map holds the fastest speed at each sample within the vehicle's limits, as
+// computed by the speed_profile tool, which the controller then tracks.
+//
+// Usage: ./map_compiler <waypoints csv> <output map> [--resolution M]
+//          [--max-speed MPH] [--max-lateral-acc M/S^2] [--max-acc M/S^2] [--max-dec M/S^2]
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "MPC.h"
+#include "speed_profile.h"
+#include "track_map.h"
+
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0] << " <waypoints csv> <output map> [options]" << std::endl;
+    return -1;
+  }
+
+  double resolution = 0.5;
+  VehicleLimits limits {70 / mps_to_mph, 9, 1, 1};
+  for (int i = 3; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--resolution") == 0) {
+      resolution = atof(argv[i + 1]);
+    } else if (strcmp(argv[i], "--max-speed") == 0) {
+      limits.max_speed = atof(argv[i + 1]) / mps_to_mph;
+    } else if (strcmp(argv[i], "--max-lateral-acc") == 0) {
+      limits.max_lateral_acc = atof(argv[i + 1]);
+    } else if (strcmp(argv[i], "--max-acc") == 0) {
+      limits.max_acc = atof(argv[i + 1]);
+    } else if (strcmp(argv[i], "--max-dec") == 0) {
+      limits.max_dec = atof(argv[i + 1]);
+    }
+  }
+  if (resolution <= 0) {
+    std::cerr << "--resolution must be positive" << std::endl;
+    return -1;
+  }
+
+  TrackMap map(resolution);
+  if (!map.Load(argv[1])) {
+    return -1;
+  }
+
+  std::vector<double> curvatures(map.size());
+  for (size_t i = 0; i < map.size(); i++) {
+    curvatures[i] = map.At(i * map.resolution()).curvature;
+  }
+  map.SetSpeeds(compute_speed_profile(curvatures, map.resolution(), limits));
+
+  if (!map.Save(argv[2])) {
+    return -1;
+  }
+  std::cout << "Wrote " << map.size() << " samples over " << map.length() << " m, "
+    << "with " << map.index().num_cells() << " index cells" << std::endl;
+}
@@ -0,0 +1,93 @@
+#ifndef OUTBOX_H
+#define OUTBOX_H
+
+#include <uWS/uWS.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Replies produced on solver threads, to be sent from an event loop thread.
+//
+// uWS sockets may only be written from the thread running their event loop, so
+// solver threads post a delivery function here, together with the time at which it
+// is due. A delayer thread wakes up the event loop when deliveries become due.
+class Outbox {
+ public:
+  typedef std::chrono::steady_clock clock;
+
+  // Must be constructed on the thread that runs `loop`.
+  explicit Outbox(uS::Loop *loop) : stopping(false) {
+    async = new uS::Async(loop);
+    async->setData(this);
+    async->start([](uS::Async *async) {
+      static_cast<Outbox *>(async->getData())->DeliverReady();
+    });
+    delayer = std::thread(&Outbox::Delay, this);
+  }
+
+  virtual ~Outbox() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    cv.notify_all();
+    delayer.join();
+    async->close();
+  }
+
+  // Run `deliver` on the event loop thread, no earlier than `due`.
+  void Post(clock::time_point due, std::function<void()> deliver) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      scheduled.emplace(due, std::move(deliver));
+    }
+    cv.notify_one();
+  }
+
+ private:
+  void Delay() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+      if (scheduled.empty()) {
+        cv.wait(lock);
+        continue;
+      }
+      auto due = scheduled.begin()->first;
+      if (clock::now() < due) {
+        cv.wait_until(lock, due);
+        continue;
+      }
+      auto end = scheduled.upper_bound(clock::now());
+      for (auto it = scheduled.begin(); it != end; it++) {
+        ready.push_back(std::move(it->second));
+      }
+      scheduled.erase(scheduled.begin(), end);
+      async->send();
+    }
+  }
+
+  void DeliverReady() {
+    std::vector<std::function<void()>> delivering;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      delivering.swap(ready);
+    }
+    for (auto & deliver : delivering) {
+      deliver();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::multimap<clock::time_point, std::function<void()>> scheduled;
+  std::vector<std::function<void()>> ready;
+  bool stopping;
+  uS::Async *async;
+  std::thread delayer;
+};
+
+#endif /* OUTBOX_H */
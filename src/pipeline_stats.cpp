@@ -0,0 +1,57 @@
+#include "pipeline_stats.h"
+#include <iomanip>
+#include <utility>
+
+const char *pipeline_stage_name(pipeline_stage stage) {
+  static const char *names[num_pipeline_stages] = {
+    "frame", "queue", "parse", "transform", "fit", "predict", "localize", "mpc_setup",
+    "ipopt", "mpc_extract", "commit", "serialize", "send"};
+  return names[stage];
+}
+
+void PipelineStats::RecordControl(const ControlTimings & timings) {
+  const std::pair<pipeline_stage, double> stages[] = {
+    {stage_transform, timings.transform},
+    {stage_fit, timings.fit},
+    {stage_predict, timings.predict},
+    {stage_localize, timings.localize},
+    {stage_solve_setup, timings.solve_stages.setup},
+    {stage_solve_optimize, timings.solve_stages.optimize},
+    {stage_solve_extract, timings.solve_stages.extract},
+    {stage_commit, timings.commit}};
+  for (const auto & stage : stages) {
+    if (stage.second > 0) {
+      Record(stage.first, stage.second);
+    }
+  }
+}
+
+void PipelineStats::Add(const PipelineStats & other) {
+  for (int stage = 0; stage < num_pipeline_stages; stage++) {
+    histograms[stage].Add(other.histograms[stage]);
+  }
+}
+
+void PipelineStats::Print(std::ostream & out) const {
+  std::ios::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out << std::setw(12) << "stage" << std::setw(10) << "count" << std::setw(10) << "mean"
+    << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+    << std::setw(10) << "p99.9" << std::setw(10) << "max" << " (us)" << std::endl;
+  for (int stage = 0; stage < num_pipeline_stages; stage++) {
+    const LatencyHistogram & histogram = histograms[stage];
+    if (histogram.count() == 0) {
+      continue;
+    }
+    out << std::setw(12) << pipeline_stage_name((pipeline_stage) stage)
+      << std::setw(10) << histogram.count() << std::fixed << std::setprecision(1)
+      << std::setw(10) << histogram.mean() * 1e6
+      << std::setw(10) << histogram.quantile(0.5) * 1e6
+      << std::setw(10) << histogram.quantile(0.9) * 1e6
+      << std::setw(10) << histogram.quantile(0.99) * 1e6
+      << std::setw(10) << histogram.quantile(0.999) * 1e6
+      << std::setw(10) << histogram.max() * 1e6 << std::endl;
+  }
+  out.flags(flags);
+  out.precision(precision);
+}
@@ -0,0 +1,51 @@
+#ifndef PIPELINE_STATS_H
+#define PIPELINE_STATS_H
+
+#include <ostream>
+#include "controller.h"
+#include "latency_histogram.h"
+
+// The stages of the server's pipeline, from a WebSocket message to its reply.
+enum pipeline_stage {
+  stage_frame, // extraction of the telemetry event from the WebSocket message, on the event loop
+  stage_queue, // from receiving the telemetry until a solver takes it
+  stage_parse, // of the JSON, or the binary wire format
+  stage_transform, // of the waypoints into the car's coordinate system
+  stage_fit, // of the reference polynomial
+  stage_predict, // of the state after the actuation delay
+  stage_localize, // on the track map
+  stage_solve_setup, // of the bounds, the warm start and the objective
+  stage_solve_optimize, // in IPOPT, or in a sensitivity update
+  stage_solve_extract, // of the solution and the next warm start
+  stage_commit, // of the actuation to the history, and the steer event
+  stage_serialize, // of the steer event
+  stage_send, // of the reply, on the event loop
+  num_pipeline_stages
+};
+
+const char *pipeline_stage_name(pipeline_stage stage);
+
+// A latency histogram of each stage of the pipeline, for one session, or several merged.
+// Recording is lock-free, so that the solver and the event loop record while any other
+// thread reads.
+class PipelineStats {
+ public:
+  void Record(pipeline_stage stage, double seconds) { histograms[stage].Record(seconds); }
+
+  // The stages that ran in a `Controller::Control` call.
+  void RecordControl(const ControlTimings & timings);
+
+  const LatencyHistogram & histogram(pipeline_stage stage) const { return histograms[stage]; }
+
+  // Add the counts of `other` to these.
+  void Add(const PipelineStats & other);
+
+  // A table of the count, mean, percentiles and largest time of each stage with samples,
+  // in microseconds.
+  void Print(std::ostream & out) const;
+
+ private:
+  LatencyHistogram histograms[num_pipeline_stages];
+};
+
+#endif /* PIPELINE_STATS_H */
@@ -0,0 +1,102 @@
+#include "polyfit.h"
+#include <math.h>
+#include <algorithm>
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "Eigen-3.3/Eigen/QR"
+
+// Fit a polynomial.
+// Adapted from
+// https://github.com/JuliaMath/Polynomials.jl/blob/master/src/Polynomials.jl#L676-L716
+Eigen::VectorXd polyfit(const Eigen::VectorXd & xvals, const Eigen::VectorXd & yvals,
+                        int order) {
+  assert(xvals.size() == yvals.size());
+  assert(order >= 1 && order <= xvals.size() - 1);
+  Eigen::MatrixXd A(xvals.size(), order + 1);
+
+  for (int i = 0; i < xvals.size(); i++) {
+    A(i, 0) = 1.0;
+  }
+
+  for (int j = 0; j < xvals.size(); j++) {
+    for (int i = 0; i < order; i++) {
+      A(j, i + 1) = A(j, i) * xvals(j);
+    }
+  }
+
+  auto Q = A.householderQr();
+  auto result = Q.solve(yvals);
+  return result;
+}
+
+bool fit_cubic(const double *xvals, const double *yvals, size_t n, Eigen::Vector4d & coeffs,
+               double min_rcond) {
+  if (n < 4) {
+    return false;
+  }
+  if (n > (size_t) cubic_fit_max_points) {
+    coeffs = polyfit(Eigen::Map<const Eigen::VectorXd>(xvals, n),
+                     Eigen::Map<const Eigen::VectorXd>(yvals, n), 3);
+    return true;
+  }
+
+  double scale = 0;
+  for (size_t i = 0; i < n; i++) {
+    scale = std::max(scale, fabs(xvals[i]));
+  }
+  if (scale == 0) {
+    return false;
+  }
+
+  // The normal matrix is the Hankel matrix of the power sums of x / scale.
+  double power_sums[7] = {0};
+  Eigen::Vector4d moments = Eigen::Vector4d::Zero();
+  for (size_t i = 0; i < n; i++) {
+    double x = xvals[i] / scale;
+    double power = 1;
+    for (int k = 0; k < 7; k++) {
+      power_sums[k] += power;
+      if (k < 4) {
+        moments[k] += power * yvals[i];
+      }
+      power *= x;
+    }
+  }
+  Eigen::Matrix4d normal;
+  for (int r = 0; r < 4; r++) {
+    for (int c = 0; c < 4; c++) {
+      normal(r, c) = power_sums[r + c];
+    }
+  }
+
+  // The squared ratio of the smallest to the largest diagonal element of the Cholesky
+  // factor bounds the reciprocal condition number from above, for next to nothing.
+  Eigen::LLT<Eigen::Matrix4d> llt(normal);
+  bool well_conditioned = false;
+  if (llt.info() == Eigen::Success) {
+    Eigen::Vector4d diagonal = llt.matrixLLT().diagonal();
+    double ratio = diagonal.minCoeff() / diagonal.maxCoeff();
+    well_conditioned = ratio * ratio >= min_rcond;
+  }
+  if (well_conditioned) {
+    coeffs = llt.solve(moments);
+  } else {
+    // The Vandermonde matrix of x / scale, on the stack.
+    typedef Eigen::Matrix<double, Eigen::Dynamic, 4, 0, cubic_fit_max_points, 4> Vandermonde;
+    typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, cubic_fit_max_points, 1> Values;
+    Vandermonde A(n, 4);
+    for (size_t i = 0; i < n; i++) {
+      double x = xvals[i] / scale;
+      A(i, 0) = 1;
+      A(i, 1) = x;
+      A(i, 2) = x * x;
+      A(i, 3) = x * x * x;
+    }
+    coeffs = Eigen::HouseholderQR<Vandermonde>(A).solve(Eigen::Map<const Values>(yvals, n));
+  }
+
+  // Undo the scaling: the coefficient of x^k is that of (x / scale)^k over scale^k.
+  coeffs[1] /= scale;
+  coeffs[2] /= scale * scale;
+  coeffs[3] /= scale * scale * scale;
+  return true;
+}
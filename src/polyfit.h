@@ -0,0 +1,24 @@
+#ifndef POLYFIT_H
+#define POLYFIT_H
+
+#include <cstddef>
+#include "Eigen-3.3/Eigen/Core"
+
+// Fit a polynomial.
+Eigen::VectorXd polyfit(const Eigen::VectorXd & xvals, const Eigen::VectorXd & yvals,
+                        int order);
+
+// The most points `fit_cubic` fits without allocating, e.g. the waypoints of a telemetry event.
+const int cubic_fit_max_points = 16;
+
+// Fit a cubic, i.e. `polyfit(xvals, yvals, 3)`, with no heap allocation if there are at
+// most `cubic_fit_max_points` points.
+//
+// The x values are scaled to [-1, 1], and the normal equations of the scaled Vandermonde
+// matrix are solved by Cholesky. If a bound on their reciprocal condition number is below
+// `min_rcond`, e.g. when points bunch up, the Vandermonde matrix is solved by QR instead.
+// Return false if there are fewer than 4 points.
+bool fit_cubic(const double *xvals, const double *yvals, size_t n, Eigen::Vector4d & coeffs,
+               double min_rcond = 1e-10);
+
+#endif /* POLYFIT_H */
@@ -0,0 +1,225 @@
+#include "polyline_index.h"
+#include <math.h>
+#include <algorithm>
+#include <functional>
+
+// Bounds the memory of the grid, whatever the extent of the polyline.
+static const double max_cells = 1 << 22;
+
+const double PolylineIndex::walk_radius = 5;
+
+PolylineIndex::PolylineIndex() :
+  xs(nullptr),
+  ys(nullptr),
+  n(0),
+  closed(false),
+  cell(1),
+  min_x(0),
+  min_y(0),
+  num_x(0),
+  num_y(0),
+  cell_start_storage(1, 0) {
+  cell_starts = cell_start_storage.data();
+  cell_segment_list = cell_segment_storage.data();
+}
+
+void PolylineIndex::Build(const double *xs, const double *ys, size_t n, bool closed,
+                          double cell_size) {
+  this->xs = xs;
+  this->ys = ys;
+  this->n = n;
+  this->closed = closed;
+  cell_start_storage.assign(1, 0);
+  cell_segment_storage.clear();
+  cell_starts = cell_start_storage.data();
+  cell_segment_list = cell_segment_storage.data();
+  num_x = num_y = 0;
+  if (n < 2) {
+    return;
+  }
+
+  min_x = *std::min_element(xs, xs + n);
+  min_y = *std::min_element(ys, ys + n);
+  double extent_x = *std::max_element(xs, xs + n) - min_x;
+  double extent_y = *std::max_element(ys, ys + n) - min_y;
+
+  size_t segments = num_segments();
+  if (cell_size <= 0) {
+    double total_length = 0;
+    for (size_t i = 0; i < segments; i++) {
+      size_t next = (i + 1) % n;
+      total_length += hypot(xs[next] - xs[i], ys[next] - ys[i]);
+    }
+    cell_size = 4 * total_length / segments;
+  }
+  cell = std::max(cell_size, sqrt((extent_x + cell_size) * (extent_y + cell_size) / max_cells));
+  num_x = (int64_t) (extent_x / cell) + 1;
+  num_y = (int64_t) (extent_y / cell) + 1;
+
+  // Bucket each segment into every cell its bounding box overlaps, in two passes:
+  // count, then fill.
+  auto for_each_cell = [this](size_t i, size_t next, const std::function<void(int64_t)> & f) {
+    int64_t x0 = (int64_t) ((std::min(this->xs[i], this->xs[next]) - min_x) / cell);
+    int64_t x1 = (int64_t) ((std::max(this->xs[i], this->xs[next]) - min_x) / cell);
+    int64_t y0 = (int64_t) ((std::min(this->ys[i], this->ys[next]) - min_y) / cell);
+    int64_t y1 = (int64_t) ((std::max(this->ys[i], this->ys[next]) - min_y) / cell);
+    for (int64_t cy = y0; cy <= y1; cy++) {
+      for (int64_t cx = x0; cx <= x1; cx++) {
+        f(cy * num_x + cx);
+      }
+    }
+  };
+
+  std::vector<uint32_t> & start = cell_start_storage;
+  std::vector<uint32_t> & list = cell_segment_storage;
+  start.assign(num_x * num_y + 1, 0);
+  for (size_t i = 0; i < segments; i++) {
+    for_each_cell(i, (i + 1) % n, [&start](int64_t c) { start[c + 1]++; });
+  }
+  for (int64_t c = 0; c < num_x * num_y; c++) {
+    start[c + 1] += start[c];
+  }
+  list.resize(start.back());
+  std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+  for (size_t i = 0; i < segments; i++) {
+    for_each_cell(i, (i + 1) % n, [&list, &fill, i](int64_t c) { list[fill[c]++] = i; });
+  }
+  cell_starts = start.data();
+  cell_segment_list = list.data();
+}
+
+void PolylineIndex::Attach(const double *xs, const double *ys, size_t n, bool closed,
+                           const Grid & grid, const uint32_t *cell_start,
+                           const uint32_t *cell_segments) {
+  this->xs = xs;
+  this->ys = ys;
+  this->n = n;
+  this->closed = closed;
+  cell = grid.cell_size;
+  min_x = grid.min_x;
+  min_y = grid.min_y;
+  num_x = grid.num_x;
+  num_y = grid.num_y;
+  cell_start_storage.clear();
+  cell_segment_storage.clear();
+  cell_starts = cell_start;
+  cell_segment_list = cell_segments;
+}
+
+double PolylineIndex::SegmentDistance(size_t i, double x, double y, double & t) const {
+  size_t next = i + 1 == n ? 0 : i + 1;
+  double dx = xs[next] - xs[i];
+  double dy = ys[next] - ys[i];
+  double length_squared = dx * dx + dy * dy;
+  t = length_squared > 0 ? ((x - xs[i]) * dx + (y - ys[i]) * dy) / length_squared : 0;
+  t = std::max(0.0, std::min(1.0, t));
+  double ex = xs[i] + t * dx - x;
+  double ey = ys[i] + t * dy - y;
+  return ex * ex + ey * ey;
+}
+
+size_t PolylineIndex::Nearest(double x, double y, size_t hint, double & t,
+                              double & distance_squared) const {
+  if (hint < num_segments()) {
+    size_t nearest = Walk(x, y, hint, t, distance_squared);
+    if (distance_squared <= walk_radius * walk_radius) {
+      return nearest;
+    }
+  }
+  return SearchGrid(x, y, t, distance_squared);
+}
+
+size_t PolylineIndex::Walk(double x, double y, size_t hint, double & t,
+                           double & distance_squared) const {
+  int64_t segments = num_segments();
+  size_t nearest = hint;
+  distance_squared = SegmentDistance(nearest, x, y, t);
+
+  // Walk forward while getting nearer, else backward. The stride doubles while the
+  // segments get nearer and halves once they do not, so that the walk takes
+  // logarithmic steps in the distance travelled since the hint, however dense the
+  // polyline. When the hint is still nearest, only its two neighbors are checked.
+  for (int direction : {1, -1}) {
+    int64_t stride = 1;
+    while (stride > 0) {
+      int64_t candidate = (int64_t) nearest + direction * stride;
+      if (closed) {
+        candidate = ((candidate % segments) + segments) % segments;
+      } else if (candidate < 0 || candidate >= segments) {
+        stride /= 2;
+        continue;
+      }
+      double candidate_t;
+      double candidate_distance = SegmentDistance(candidate, x, y, candidate_t);
+      if (candidate_distance < distance_squared) {
+        nearest = candidate;
+        distance_squared = candidate_distance;
+        t = candidate_t;
+        stride *= 2;
+      } else {
+        stride /= 2;
+      }
+    }
+  }
+  return nearest;
+}
+
+size_t PolylineIndex::SearchGrid(double x, double y, double & t, double & distance_squared) const {
+  size_t nearest = 0;
+  distance_squared = INFINITY;
+  t = 0;
+  // A non-finite position has no cell, and no nearest segment.
+  if (num_x == 0 || !isfinite(x) || !isfinite(y)) {
+    return nearest;
+  }
+
+  // Start from the cell of the grid nearest to the position, which may be outside it.
+  // Every cell is at least `outside` away, the distance to the grid's bounding box.
+  double max_x = min_x + num_x * cell;
+  double max_y = min_y + num_y * cell;
+  double outside_x = std::max(0.0, std::max(min_x - x, x - max_x));
+  double outside_y = std::max(0.0, std::max(min_y - y, y - max_y));
+  double outside_squared = outside_x * outside_x + outside_y * outside_y;
+  int64_t cx = (int64_t) std::min((double) (num_x - 1), std::max(0.0, floor((x - min_x) / cell)));
+  int64_t cy = (int64_t) std::min((double) (num_y - 1), std::max(0.0, floor((y - min_y) / cell)));
+  // Beyond this ring, every cell of the grid has been visited.
+  int64_t max_ring = std::max(std::max(cx, num_x - 1 - cx), std::max(cy, num_y - 1 - cy));
+
+  auto visit = [&](int64_t gx, int64_t gy) {
+    if (gx < 0 || gy < 0 || gx >= num_x || gy >= num_y) {
+      return;
+    }
+    int64_t c = gy * num_x + gx;
+    for (uint32_t k = cell_starts[c]; k < cell_starts[c + 1]; k++) {
+      double candidate_t;
+      double candidate_distance = SegmentDistance(cell_segment_list[k], x, y, candidate_t);
+      if (candidate_distance < distance_squared) {
+        nearest = cell_segment_list[k];
+        distance_squared = candidate_distance;
+        t = candidate_t;
+      }
+    }
+  };
+
+  for (int64_t ring = 0; ring <= max_ring; ring++) {
+    // Any segment in a cell of this ring or beyond is at least (ring - 1) cells away from
+    // the nearest point of the bounding box, which is in the starting cell.
+    double bound = (ring - 1) * cell;
+    if (ring > 0 && distance_squared <= outside_squared + bound * bound) {
+      break;
+    }
+    if (ring == 0) {
+      visit(cx, cy);
+      continue;
+    }
+    for (int64_t d = -ring; d <= ring; d++) {
+      visit(cx + d, cy - ring);
+      visit(cx + d, cy + ring);
+    }
+    for (int64_t d = -ring + 1; d <= ring - 1; d++) {
+      visit(cx - ring, cy + d);
+      visit(cx + ring, cy + d);
+    }
+  }
+  return nearest;
+}
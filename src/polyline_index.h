@@ -0,0 +1,92 @@
+#ifndef POLYLINE_INDEX_H
+#define POLYLINE_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Finds the segment of a polyline nearest to a position, e.g. to localize a vehicle on a track.
+//
+// Segments are bucketed into a uniform grid of square cells, stored compactly: the
+// segments of cell c are `cell_segments[cell_start[c]]` to `cell_segments[cell_start[c + 1] - 1]`.
+// Without a hint, a search visits rings of cells around the position, until no unvisited
+// cell can hold a nearer segment.
+//
+// With a hint, i.e. the nearest segment to the vehicle's previous position, the search walks
+// along the polyline while the segments get nearer, which usually checks two or three of them,
+// however large the polyline. The walk finds a local minimum of the distance, so it is only
+// trusted if the segment found is within `walk_radius`, assuming that where the track comes
+// back near itself, its parts are farther apart than that. Otherwise the grid is searched.
+class PolylineIndex {
+ public:
+  static const size_t no_hint = (size_t) -1;
+
+  static const double walk_radius; // meter
+
+  // The layout of the grid, which together with the cell tables describes a built index.
+  struct Grid {
+    double cell_size;
+    double min_x;
+    double min_y;
+    int64_t num_x;
+    int64_t num_y;
+  };
+
+  PolylineIndex();
+
+  // The cell tables may be owned by the index.
+  PolylineIndex(const PolylineIndex &) = delete;
+  PolylineIndex & operator=(const PolylineIndex &) = delete;
+
+  // Index the polyline through the `n` points `xs`, `ys`, which must outlive the index.
+  // If `closed`, the last point connects back to the first. If `cell_size` is not positive,
+  // it is chosen so that a cell holds a few segments. Cells are enlarged if need be,
+  // to bound their number.
+  void Build(const double *xs, const double *ys, size_t n, bool closed, double cell_size = 0);
+
+  // Restore an index saved from `grid()`, `cell_start()` and `cell_segments()`, over the same
+  // polyline, without copying the tables, e.g. from a mapped file. They must outlive the index.
+  void Attach(const double *xs, const double *ys, size_t n, bool closed, const Grid & grid,
+              const uint32_t *cell_start, const uint32_t *cell_segments);
+
+  // The segment nearest to (x, y), i.e. from point i to point i + 1, and the fraction
+  // `t` in [0, 1] along it of the nearest point, and the squared distance to that point.
+  // If (x, y) is not finite, the squared distance is infinite.
+  size_t Nearest(double x, double y, size_t hint, double & t, double & distance_squared) const;
+
+  size_t num_segments() const { return closed ? n : n - 1; }
+  double cell_size() const { return cell; }
+
+  Grid grid() const { return Grid {cell, min_x, min_y, num_x, num_y}; }
+  size_t num_cells() const { return num_x * num_y; }
+  // `num_cells() + 1` offsets, and `num_cell_segments()` segments.
+  const uint32_t *cell_start() const { return cell_starts; }
+  const uint32_t *cell_segments() const { return cell_segment_list; }
+  size_t num_cell_segments() const { return cell_starts[num_cells()]; }
+
+ private:
+  // The squared distance from (x, y) to segment i, and the fraction along it of the nearest point.
+  double SegmentDistance(size_t i, double x, double y, double & t) const;
+
+  size_t Walk(double x, double y, size_t hint, double & t, double & distance_squared) const;
+  size_t SearchGrid(double x, double y, double & t, double & distance_squared) const;
+
+  const double *xs;
+  const double *ys;
+  size_t n;
+  bool closed;
+
+  double cell;
+  double min_x;
+  double min_y;
+  int64_t num_x;
+  int64_t num_y;
+  // num_x * num_y + 1 offsets into `cell_segment_list`. Either point into the storage
+  // below, or into tables from `Attach`.
+  const uint32_t *cell_starts;
+  const uint32_t *cell_segment_list;
+  std::vector<uint32_t> cell_start_storage;
+  std::vector<uint32_t> cell_segment_storage;
+};
+
+#endif /* POLYLINE_INDEX_H */
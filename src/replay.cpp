@@ -0,0 +1,277 @@
+// Replays a telemetry log of `./mpc --record` through the controller, as fast as it goes.
+//
+// Each recorded session gets its own controller, with the controller options of the
+// recording server's command line, on a virtual clock that reads the recorded times,
+// so that the delay prediction, the actuation history and the adaptive delay see what
+// they saw live. Each frame is parsed and controlled as the server did, with the
+// cancellations and the speculative solves it recorded, and the actuations are checked
+// against the recorded ones. Prints the time spent in each stage of the pipeline.
+//
+// Usage: ./replay LOG [--tolerance T] [--session ID] [--track-map FILE]
+//          [--speed-profile CSV] [--verbose]
+//
+// `--track-map` and `--speed-profile` override the recorded paths, e.g. when the server
+// ran in another directory.
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "controller.h"
+#include "telemetry_log.h"
+#include "wire.h"
+
+using std::string;
+using std::vector;
+
+// A recorded session, replayed.
+struct ReplaySession {
+  std::unique_ptr<Controller> controller;
+
+  // The times the controller's clock reads next, in order. The last one repeats.
+  vector<std::chrono::steady_clock::time_point> times;
+  size_t next_time = 0;
+
+  // Latencies recorded since the session's last `Control`, as (time, seconds).
+  std::deque<std::pair<int64_t, double>> latencies;
+};
+
+// The wall times of one stage, in seconds.
+struct StageTimes {
+  const char *name;
+  vector<double> samples;
+};
+
+static void print_stage(StageTimes & stage) {
+  vector<double> & samples = stage.samples;
+  if (samples.empty()) {
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  double sum = 0;
+  for (double t : samples) {
+    sum += t;
+  }
+  auto quantile = [&samples](double q) {
+    return samples[std::min(samples.size() - 1, (size_t) (q * samples.size()))] * 1e6;
+  };
+  std::cout << std::setw(10) << stage.name << std::setw(12) << sum / samples.size() * 1e6
+    << std::setw(12) << quantile(0.5) << std::setw(12) << quantile(0.99)
+    << std::setw(12) << samples.back() * 1e6 << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  typedef std::chrono::steady_clock clock;
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " LOG [--tolerance T] [--session ID] "
+      "[--track-map FILE] [--speed-profile CSV] [--verbose]" << std::endl;
+    return -1;
+  }
+  string log_path = argv[1];
+  double tolerance = 1e-9;
+  bool has_session_filter = false;
+  uint32_t session_filter = 0;
+  string track_map_path, speed_profile_path;
+  bool override_track_map = false, override_speed_profile = false;
+  bool verbose = false;
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+      tolerance = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--session") == 0 && i + 1 < argc) {
+      has_session_filter = true;
+      session_filter = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--track-map") == 0 && i + 1 < argc) {
+      track_map_path = argv[++i];
+      override_track_map = true;
+    } else if (strcmp(argv[i], "--speed-profile") == 0 && i + 1 < argc) {
+      speed_profile_path = argv[++i];
+      override_speed_profile = true;
+    } else if (strcmp(argv[i], "--verbose") == 0) {
+      verbose = true;
+    } else {
+      std::cerr << "Unknown option " << argv[i] << std::endl;
+      return -1;
+    }
+  }
+
+  TelemetryLogReader log;
+  if (!log.Open(log_path)) {
+    return -1;
+  }
+
+  // The controller options, as the server parsed them. Its other options are ignored.
+  vector<char *> server_argv;
+  std::cout << "Recorded by:";
+  for (const string & arg : log.args()) {
+    server_argv.push_back(const_cast<char *>(arg.c_str()));
+    std::cout << " " << arg;
+  }
+  std::cout << std::endl;
+  ControllerOptions options;
+  for (int i = 1; i < (int) server_argv.size(); i++) {
+    if (strcmp(server_argv[i], "--track-map") == 0 && i + 1 < (int) server_argv.size()) {
+      if (!override_track_map) {
+        track_map_path = server_argv[i + 1];
+      }
+      i++;
+    } else if (strcmp(server_argv[i], "--speed-profile") == 0 &&
+               i + 1 < (int) server_argv.size()) {
+      if (!override_speed_profile) {
+        speed_profile_path = server_argv[i + 1];
+      }
+      i++;
+    } else {
+      options.Parse(server_argv.size(), server_argv.data(), i);
+    }
+  }
+
+  TrackMap track_map;
+  if (!track_map_path.empty()) {
+    if (!track_map.Load(track_map_path)) {
+      return -1;
+    }
+    if (!speed_profile_path.empty() && !track_map.LoadSpeeds(speed_profile_path)) {
+      return -1;
+    }
+    options.track_map = &track_map;
+  }
+
+  std::map<uint32_t, std::unique_ptr<ReplaySession>> sessions;
+  StageTimes parse {"parse"}, transform {"transform"}, fit {"fit"}, predict {"predict"},
+    localize {"localize"}, solve {"solve"}, commit {"commit"}, speculate {"speculate"};
+  size_t num_frames = 0, num_mismatches = 0;
+  double max_difference = 0;
+
+  auto replay_start = clock::now();
+  const TelemetryLogRecord *record;
+  const char *data;
+  while (log.Next(record, data)) {
+    if (has_session_filter && record->session != session_filter) {
+      continue;
+    }
+
+    if (record->type == record_open) {
+      std::unique_ptr<ReplaySession> & session = sessions[record->session];
+      session.reset(new ReplaySession());
+      ReplaySession *replay = session.get();
+      replay->times.push_back(from_log_time(record->time));
+      ControllerOptions session_options = options;
+      session_options.now = [replay]() {
+        return replay->times[std::min(replay->next_time++, replay->times.size() - 1)];
+      };
+      session->controller.reset(new Controller(session_options));
+      continue;
+    }
+
+    auto found = sessions.find(record->session);
+    if (found == sessions.end()) {
+      continue;
+    }
+    ReplaySession & session = *found->second;
+    Controller & controller = *session.controller;
+
+    if (record->type == record_latency) {
+      session.latencies.emplace_back(record->time, record->latency);
+      continue;
+    }
+    if (record->type == record_speculation) {
+      auto speculate_start = clock::now();
+      if (controller.Speculate()) {
+        speculate.samples.push_back(
+          std::chrono::duration<double>(clock::now() - speculate_start).count());
+      }
+      continue;
+    }
+    if (record->type != record_telemetry) {
+      continue;
+    }
+    num_frames++;
+
+    // The controller read its latency estimate as `Control` started. Latencies measured
+    // while it solved were logged before it, but only count from the next frame.
+    while (!session.latencies.empty() &&
+           session.latencies.front().first <= record->control_start) {
+      controller.RecordLatency(session.latencies.front().second);
+      session.latencies.pop_front();
+    }
+
+    auto parse_start = clock::now();
+    Telemetry telemetry;
+    if (record->binary) {
+      if (!decode_telemetry(data, record->data_size, telemetry)) {
+        std::cerr << "Malformed binary telemetry" << std::endl;
+        continue;
+      }
+    } else {
+      parse_telemetry_json(string(data, record->data_size), telemetry);
+    }
+    parse.samples.push_back(std::chrono::duration<double>(clock::now() - parse_start).count());
+
+    // The controller's clock reads the start, then the commit.
+    session.times = {from_log_time(record->control_start), from_log_time(record->committed)};
+    session.next_time = 0;
+    int cancel_polls = 0;
+    int recorded_cancel_polls = record->cancel_polls;
+    auto should_cancel = [&cancel_polls, recorded_cancel_polls]() {
+      return ++cancel_polls == recorded_cancel_polls;
+    };
+
+    Actuation actuation;
+    bool solved = controller.Control(telemetry, should_cancel, actuation);
+    const ControlTimings & timings = controller.timings();
+    transform.samples.push_back(timings.transform);
+    fit.samples.push_back(timings.fit);
+    predict.samples.push_back(timings.predict);
+    if (options.track_map != nullptr) {
+      localize.samples.push_back(timings.localize);
+    }
+    if (timings.solve > 0) {
+      solve.samples.push_back(timings.solve);
+    }
+    if (solved) {
+      commit.samples.push_back(timings.commit);
+    }
+
+    double difference = 0;
+    if (solved && record->solved) {
+      difference = std::max(fabs(actuation.steering_angle - record->steering_angle),
+                            fabs(actuation.throttle - record->throttle));
+      max_difference = std::max(max_difference, difference);
+    }
+    if (solved != (bool) record->solved || difference > tolerance) {
+      num_mismatches++;
+      if (verbose) {
+        std::cout << "Session " << record->session << " at " << record->time << " ns: ";
+        if (solved != (bool) record->solved) {
+          std::cout << (solved ? "solved, recorded cancelled" : "cancelled, recorded solved");
+        } else {
+          std::cout << "steering " << actuation.steering_angle << ", recorded "
+            << record->steering_angle << ", throttle " << actuation.throttle << ", recorded "
+            << record->throttle;
+        }
+        std::cout << std::endl;
+      }
+    }
+  }
+  double replay_s = std::chrono::duration<double>(clock::now() - replay_start).count();
+
+  std::cout << "Replayed " << num_frames << " frames of " << sessions.size() << " sessions in "
+    << replay_s << " s (" << num_frames / replay_s << " frames/s)" << std::endl;
+  std::cout << std::setw(10) << "stage" << std::setw(12) << "mean (us)" << std::setw(12) << "p50"
+    << std::setw(12) << "p99" << std::setw(12) << "max" << std::endl;
+  for (StageTimes *stage : {&parse, &transform, &fit, &predict, &localize, &solve, &commit,
+                            &speculate}) {
+    print_stage(*stage);
+  }
+  std::cout << num_mismatches << " actuations differ from the recorded ones by more than "
+    << tolerance << ", largest difference " << max_difference << std::endl;
+  return num_mismatches == 0 ? 0 : 1;
+}
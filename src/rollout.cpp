@@ -0,0 +1,125 @@
+#include "rollout.h"
+#include <algorithm>
+#include <thread>
+#include "simd_pack.h"
+#include "vehicle_model.h"
+
+using std::vector;
+
+// Vehicles per tile: the states and inputs of a tile take 48 KB.
+static const size_t tile_size = 1024;
+
+typedef void (*StepKernel)(double *x, double *y, double *psi, double *v,
+                           const double *steering, const double *acceleration,
+                           size_t n, double dt);
+
+// One step of `n` vehicles, `Pack::size` at a time, then the rest one at a time with the
+// same arithmetic. The kernels flatten it, so that it is compiled for their targets.
+template <class P>
+inline void step_vehicles(double *x, double *y, double *psi, double *v,
+                          const double *steering, const double *acceleration,
+                          size_t n, double dt) {
+  size_t i = 0;
+  for (; i + P::size <= n; i += P::size) {
+    VehicleState<P> state {P::Load(x + i), P::Load(y + i), P::Load(psi + i), P::Load(v + i)};
+    VehicleInput<P> input {P::Load(steering + i), P::Load(acceleration + i)};
+    VehicleState<P> next = step(state, input, P(dt));
+    next.x.Store(x + i);
+    next.y.Store(y + i);
+    next.psi.Store(psi + i);
+    next.v.Store(v + i);
+  }
+  for (; i < n; i++) {
+    typedef Pack<1> P1;
+    VehicleState<P1> state {P1(x[i]), P1(y[i]), P1(psi[i]), P1(v[i])};
+    VehicleInput<P1> input {P1(steering[i]), P1(acceleration[i])};
+    VehicleState<P1> next = step(state, input, P1(dt));
+    x[i] = next.x.lane[0];
+    y[i] = next.y.lane[0];
+    psi[i] = next.psi.lane[0];
+    v[i] = next.v.lane[0];
+  }
+}
+
+static void step_sse2(double *x, double *y, double *psi, double *v, const double *steering,
+                      const double *acceleration, size_t n, double dt) {
+  step_vehicles<Pack<2>>(x, y, psi, v, steering, acceleration, n, dt);
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ROLLOUT_HAS_AVX_KERNELS
+
+__attribute__((target("avx2,fma"), flatten))
+static void step_avx2(double *x, double *y, double *psi, double *v, const double *steering,
+                      const double *acceleration, size_t n, double dt) {
+  step_vehicles<Pack4d>(x, y, psi, v, steering, acceleration, n, dt);
+}
+
+__attribute__((target("avx512f"), flatten))
+static void step_avx512(double *x, double *y, double *psi, double *v, const double *steering,
+                        const double *acceleration, size_t n, double dt) {
+  step_vehicles<Pack8d>(x, y, psi, v, steering, acceleration, n, dt);
+}
+
+#endif
+
+static StepKernel select_kernel(const char *& name) {
+#ifdef ROLLOUT_HAS_AVX_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    name = "avx512";
+    return step_avx512;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    name = "avx2";
+    return step_avx2;
+  }
+#endif
+  name = "sse2";
+  return step_sse2;
+}
+
+static const char *kernel = nullptr;
+static const StepKernel step_kernel = select_kernel(kernel);
+
+RolloutEngine::RolloutEngine(size_t num_threads) :
+  threads(num_threads > 0 ? num_threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+const char *RolloutEngine::kernel_name() {
+  return kernel;
+}
+
+void RolloutEngine::Run(VehicleBatch & batch, size_t num_steps, double dt,
+                        const RolloutPolicy & policy) const {
+  size_t n = batch.size();
+  size_t num_tiles = (n + tile_size - 1) / tile_size;
+  size_t num_workers = std::min(threads, num_tiles);
+
+  // Worker i takes the tiles i, i + num_workers, ...
+  auto work = [&](size_t worker_i) {
+    vector<double> steering(tile_size), acceleration(tile_size);
+    for (size_t tile_i = worker_i; tile_i < num_tiles; tile_i += num_workers) {
+      size_t begin = tile_i * tile_size;
+      size_t size = std::min(tile_size, n - begin);
+      RolloutTile tile {
+        begin, size, &batch.x[begin], &batch.y[begin], &batch.psi[begin], &batch.v[begin],
+        steering.data(), acceleration.data()};
+      for (size_t step_i = 0; step_i < num_steps; step_i++) {
+        policy(step_i, tile);
+        step_kernel(&batch.x[begin], &batch.y[begin], &batch.psi[begin], &batch.v[begin],
+                    steering.data(), acceleration.data(), size, dt);
+      }
+    }
+  };
+
+  vector<std::thread> workers;
+  for (size_t i = 1; i < num_workers; i++) {
+    workers.emplace_back(work, i);
+  }
+  if (num_workers > 0) {
+    work(0);
+  }
+  for (auto & worker : workers) {
+    worker.join();
+  }
+}
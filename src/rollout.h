@@ -0,0 +1,67 @@
+#ifndef ROLLOUT_H
+#define ROLLOUT_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// The states of a batch of vehicles, in structure-of-arrays layout. See `VehicleState`.
+struct VehicleBatch {
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<double> psi;
+  std::vector<double> v;
+
+  void Resize(size_t n) {
+    x.resize(n);
+    y.resize(n);
+    psi.resize(n);
+    v.resize(n);
+  }
+
+  size_t size() const { return x.size(); }
+};
+
+// The vehicles of a batch that a policy sets the inputs of, at one step: those from
+// `begin` to `begin + size - 1`. The arrays hold their states, and receive their inputs.
+struct RolloutTile {
+  size_t begin;
+  size_t size;
+  const double *x;
+  const double *y;
+  const double *psi;
+  const double *v;
+  double *steering; // radian, positive values for left turn
+  double *acceleration; // meter/sec^2
+};
+
+// Sets the inputs of a tile of vehicles at step `step_index`, from their states, i.e. closes
+// the loop. Called concurrently for different tiles.
+typedef std::function<void(size_t step_index, RolloutTile & tile)> RolloutPolicy;
+
+// Steps a batch of vehicles through the vehicle model of vehicle_model.h, e.g. thousands
+// of initial states over several seconds, to validate or tune a controller.
+//
+// The batch is cut into tiles of consecutive vehicles, which the threads take in turn.
+// A thread steps a tile through all steps before the next, so that it stays in cache.
+// Tiles are stepped with `step` on packs of vehicles, as wide as the CPU supports: AVX-512
+// or AVX2, chosen at runtime, with a polynomial sine and cosine that vectorize.
+class RolloutEngine {
+ public:
+  // If `num_threads` is 0, one per core.
+  explicit RolloutEngine(size_t num_threads = 0);
+
+  // Advance every vehicle of `batch` `num_steps` steps of `dt` seconds, with the inputs
+  // that `policy` sets at each step.
+  void Run(VehicleBatch & batch, size_t num_steps, double dt, const RolloutPolicy & policy) const;
+
+  size_t num_threads() const { return threads; }
+
+  // The instruction set of the stepping kernel: "avx512", "avx2" or "sse2".
+  static const char *kernel_name();
+
+ private:
+  size_t threads;
+};
+
+#endif /* ROLLOUT_H */
@@ -0,0 +1,95 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <uWS/uWS.h>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "controller.h"
+#include "mailbox.h"
+#include "outbox.h"
+#include "pipeline_stats.h"
+
+// The state of one simulator connection.
+//
+// `controller` is used by one solver job at a time, which the mailbox guarantees,
+// except for recording latencies, which the event loop thread does.
+// `ws` and `closed` are used on the event loop thread only.
+struct Session {
+  // Unique in the process, for the telemetry log.
+  uint32_t id;
+
+  uWS::WebSocket<uWS::SERVER> ws;
+  bool closed;
+
+  // The outbox of the event loop serving `ws`.
+  Outbox *outbox;
+
+  Controller controller;
+  TelemetryMailbox mailbox;
+
+  // Number of solves dropped because a much newer frame arrived.
+  std::atomic<size_t> cancelled;
+
+  // Number of solves that finished later than their frame's arrival plus the actuation delay.
+  std::atomic<size_t> deadline_misses;
+
+  // The time spent in each stage of the pipeline.
+  PipelineStats stats;
+
+  Session(uint32_t id, uWS::WebSocket<uWS::SERVER> ws, Outbox *outbox,
+          const ControllerOptions & controller_options, bool conflate) :
+    id(id),
+    ws(ws),
+    closed(false),
+    outbox(outbox),
+    controller(controller_options),
+    mailbox(conflate),
+    cancelled(0),
+    deadline_misses(0) {}
+};
+
+// The open sessions of all event loops, and the stats of the closed ones.
+// Thread safe.
+class SessionRegistry {
+ public:
+  void Add(std::shared_ptr<Session> session) {
+    std::lock_guard<std::mutex> lock(mutex);
+    sessions[session->id] = session;
+  }
+
+  void Remove(const Session & session) {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed_stats.Add(session.stats);
+    sessions.erase(session.id);
+  }
+
+  // The open sessions, in the order they connected.
+  std::vector<std::shared_ptr<Session>> Open() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::shared_ptr<Session>> open;
+    for (const auto & session : sessions) {
+      open.push_back(session.second);
+    }
+    return open;
+  }
+
+  // Add the stats of all sessions, open and closed, to `stats`.
+  void Total(PipelineStats & stats) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.Add(closed_stats);
+    for (const auto & session : sessions) {
+      stats.Add(session.second->stats);
+    }
+  }
+
+ private:
+  mutable std::mutex mutex;
+  std::map<uint32_t, std::shared_ptr<Session>> sessions;
+  PipelineStats closed_stats;
+};
+
+#endif /* SESSION_H */
@@ -0,0 +1,144 @@
+// Reference producer for the shared memory transport.
+//
+// Drives a car along the lake track waypoints, one telemetry record at a time, and
+// waits for each actuation. Reports the one way handoff latency of both rings and
+// the round trip time, which includes the solve.
+//
+// Usage: ./shm_client [channel name] [number of frames] [waypoints csv]
+// Run `./mpc --shm <channel name>` first.
+
+#include <math.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "shm_ring.h"
+
+using std::string;
+using std::vector;
+
+// Parse a CSV field as a number, with optional surrounding whitespace.
+bool parse_field(const string & field, double & value) {
+  const char *p = field.c_str();
+  char *end;
+  value = strtod(p, &end);
+  while (end != p && isspace(static_cast<unsigned char>(*end))) {
+    end++;
+  }
+  return end != p && *end == '\0';
+}
+
+// Print percentiles of nanosecond samples in microseconds.
+void print_percentiles(const string & label, vector<int64_t> samples) {
+  if (samples.empty()) {
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  auto at = [&samples](double q) {
+    return samples[std::min(samples.size() - 1, (size_t) (q * samples.size()))] / 1000.0;
+  };
+  std::cout << label << " (us): p50 " << at(0.5) << ", p90 " << at(0.9)
+    << ", p99 " << at(0.99) << ", max " << samples.back() / 1000.0 << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  string name = argc >= 2 ? argv[1] : "/mpc";
+  size_t num_frames = argc >= 3 ? atoi(argv[2]) : 1000;
+  string csv_path = argc >= 4 ? argv[3] : "../lake_track_waypoints.csv";
+
+  vector<double> track_x, track_y;
+  std::ifstream csv(csv_path);
+  string line;
+  std::getline(csv, line); // header
+  for (size_t line_number = 2; std::getline(csv, line); line_number++) {
+    if (line.find_first_not_of(" \t\r") == string::npos) {
+      continue;
+    }
+    std::istringstream fields(line);
+    string x, y;
+    double wp_x, wp_y;
+    if (!std::getline(fields, x, ',') || !std::getline(fields, y, ',')
+        || !parse_field(x, wp_x) || !parse_field(y, wp_y)) {
+      std::cerr << "Malformed waypoint at " << csv_path << ":" << line_number << std::endl;
+      return -1;
+    }
+    track_x.push_back(wp_x);
+    track_y.push_back(wp_y);
+  }
+  if (track_x.size() < 2) {
+    std::cerr << "Failed to read waypoints from " << csv_path << std::endl;
+    return -1;
+  }
+
+  ShmChannel channel;
+  if (!channel.Open(name, false)) {
+    return -1;
+  }
+
+  // Discard replies to a previous run.
+  ActuationRecord reply = ActuationRecord();
+  while (channel.actuation().TryPop(reply)) {}
+
+  const size_t num_pts = 6;
+  size_t num_wps = track_x.size();
+
+  vector<int64_t> to_controller, to_producer, round_trip;
+  size_t num_samples = 0; // of the actuation stream, if the controller streams
+  TelemetryRecord record = TelemetryRecord();
+
+  for (size_t frame = 0; frame < num_frames; frame++) {
+    // Place the car on a waypoint, heading to the next one.
+    size_t wp = frame % num_wps;
+    size_t next_wp = (wp + 1) % num_wps;
+    record.seq = frame;
+    record.x = track_x[wp];
+    record.y = track_y[wp];
+    record.psi = atan2(track_y[next_wp] - track_y[wp], track_x[next_wp] - track_x[wp]);
+    record.psi_unity = fmod(M_PI / 2 - record.psi + 2 * M_PI, 2 * M_PI);
+    record.speed = 40;
+    record.steering_angle = reply.steering_angle;
+    record.throttle = reply.throttle;
+    record.num_pts = num_pts;
+    for (size_t i = 0; i < num_pts; i++) {
+      record.ptsx[i] = track_x[(wp + i) % num_wps];
+      record.ptsy[i] = track_y[(wp + i) % num_wps];
+    }
+
+    record.sent_ns = shm_now_ns();
+    while (!channel.telemetry().TryPush(record)) {
+      std::this_thread::yield();
+    }
+    // Spin first, so that the handoff latency is not that of the scheduler,
+    // but eventually yield, in case the controller runs on the same core.
+    unsigned spins = 0;
+    while (!channel.actuation().TryPop(reply)) {
+      if (++spins > (1 << 16)) {
+        std::this_thread::yield();
+      }
+    }
+    int64_t received_ns = shm_now_ns();
+
+    if (reply.seq != record.seq) {
+      std::cerr << "Expected reply to " << record.seq << " but got " << reply.seq << std::endl;
+      return -1;
+    }
+    to_controller.push_back(reply.telemetry_received_ns - record.sent_ns);
+    to_producer.push_back(received_ns - reply.sent_ns);
+    round_trip.push_back(received_ns - record.sent_ns);
+
+    ActuationSample sample;
+    while (channel.stream().TryPop(sample)) {
+      num_samples++;
+    }
+  }
+
+  std::cout << num_frames << " frames, " << num_samples << " streamed actuations" << std::endl;
+  print_percentiles("Telemetry handoff", to_controller);
+  print_percentiles("Actuation handoff", to_producer);
+  print_percentiles("Round trip", round_trip);
+}
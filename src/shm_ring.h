@@ -0,0 +1,215 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+// Shared memory transport between the controller and a telemetry producer on the same host.
+//
+// A channel is a POSIX shared memory object holding two single-producer single-consumer
+// rings of fixed-layout records: telemetry from the producer to the controller, and
+// actuation back. Records carry the fields of DATA.md as native doubles, so that
+// neither side formats nor parses anything.
+
+const size_t shm_max_waypoints = 16;
+const size_t shm_max_trajectory = 32;
+
+// A telemetry event. See DATA.md.
+struct TelemetryRecord {
+  uint64_t seq;
+  int64_t sent_ns; // steady clock of the producer when the record was pushed
+  double x;
+  double y;
+  double psi;
+  double psi_unity;
+  double speed; // mile/hour
+  double steering_angle;
+  double throttle;
+  uint32_t num_pts;
+  uint32_t reserved;
+  double ptsx[shm_max_waypoints];
+  double ptsy[shm_max_waypoints];
+};
+
+// A steer event, in reply to the telemetry record of the same `seq`.
+struct ActuationRecord {
+  uint64_t seq;
+  int64_t telemetry_received_ns; // steady clock of the controller when it popped the telemetry
+  int64_t sent_ns; // steady clock of the controller when the record was pushed
+  double steering_angle;
+  double throttle;
+  uint32_t num_mpc;
+  uint32_t num_next;
+  double mpc_x[shm_max_trajectory];
+  double mpc_y[shm_max_trajectory];
+  double next_x[shm_max_waypoints];
+  double next_y[shm_max_waypoints];
+};
+
+// One actuation of the high rate stream, interpolated from the solve of telemetry `seq`.
+struct ActuationSample {
+  uint64_t seq;
+  int64_t time_ns; // steady clock of the controller when the actuation is due
+  double steering_angle;
+  double throttle;
+};
+
+// Nanoseconds of the steady clock, which is CLOCK_MONOTONIC and therefore
+// comparable between processes on the same host.
+inline int64_t shm_now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// A lock-free ring with exactly one producer and one consumer, which may live in
+// different processes. `head` and `tail` count records ever pushed and popped.
+template <class Record, size_t Capacity>
+struct SpscRing {
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of 2");
+  static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "atomics must be address free");
+
+  alignas(64) std::atomic<uint64_t> head;
+  alignas(64) std::atomic<uint64_t> tail;
+  alignas(64) Record records[Capacity];
+
+  // Producer side. Return false if the ring is full.
+  bool TryPush(const Record & record) {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+    records[h & (Capacity - 1)] = record;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Return false if the ring is empty.
+  bool TryPop(Record & record) {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    if (head.load(std::memory_order_acquire) == t) {
+      return false;
+    }
+    record = records[t & (Capacity - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Empty the ring. Neither side may be using it.
+  void Reset() {
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+  }
+
+  // Consumer side. Return true if no record is pending.
+  bool Empty() const {
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_relaxed);
+  }
+
+  // Consumer side. Pop all pending records, keeping only the newest.
+  // Return the number of records popped.
+  size_t PopNewest(Record & record) {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    uint64_t h = head.load(std::memory_order_acquire);
+    if (h == t) {
+      return 0;
+    }
+    record = records[(h - 1) & (Capacity - 1)];
+    tail.store(h, std::memory_order_release);
+    return h - t;
+  }
+};
+
+const uint32_t shm_magic = 0x4d504331; // "MPC1"
+const uint32_t shm_version = 2;
+
+struct ShmChannelLayout {
+  uint32_t magic;
+  uint32_t version;
+  SpscRing<TelemetryRecord, 64> telemetry;
+  SpscRing<ActuationRecord, 64> actuation;
+  // Written only if the controller streams actuations. See actuation_stream.h.
+  SpscRing<ActuationSample, 256> stream;
+};
+
+// A mapping of a channel.
+class ShmChannel {
+ public:
+  ShmChannel() : layout(nullptr), created(false) {}
+  ShmChannel(const ShmChannel &) = delete;
+  ShmChannel & operator=(const ShmChannel &) = delete;
+
+  // Unmap the channel, and if this mapping created it, remove its name, so that a
+  // producer can no longer open it.
+  virtual ~ShmChannel() {
+    if (layout != nullptr) {
+      munmap(layout, sizeof(ShmChannelLayout));
+    }
+    if (created) {
+      shm_unlink(name.c_str());
+    }
+  }
+
+  // Map the channel of the given name, e.g. "/mpc". The controller creates it,
+  // which resets both rings, and the producer opens the existing one.
+  bool Open(const std::string & name, bool create) {
+    int flags = create ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR;
+    int fd = shm_open(name.c_str(), flags, 0600);
+    if (fd < 0) {
+      std::cerr << "Failed to open shared memory " << name << std::endl;
+      return false;
+    }
+    if (create) {
+      this->name = name;
+      created = true;
+    }
+    if (create && ftruncate(fd, sizeof(ShmChannelLayout)) != 0) {
+      std::cerr << "Failed to size shared memory " << name << std::endl;
+      close(fd);
+      return false;
+    }
+    void *addr = mmap(nullptr, sizeof(ShmChannelLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      std::cerr << "Failed to map shared memory " << name << std::endl;
+      return false;
+    }
+    layout = static_cast<ShmChannelLayout *>(addr);
+
+    // An object left behind by a controller that did not shut down cleanly may still be
+    // mapped by its producer, so reset the header and the rings rather than rely on the
+    // truncation to zero fill them, and publish the magic last.
+    if (create) {
+      layout->magic = 0;
+      std::atomic_thread_fence(std::memory_order_release);
+      layout->telemetry.Reset();
+      layout->actuation.Reset();
+      layout->stream.Reset();
+      layout->version = shm_version;
+      std::atomic_thread_fence(std::memory_order_release);
+      layout->magic = shm_magic;
+    } else if (layout->magic != shm_magic || layout->version != shm_version) {
+      std::cerr << "Shared memory " << name << " is not an MPC channel of version "
+        << shm_version << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  SpscRing<TelemetryRecord, 64> & telemetry() { return layout->telemetry; }
+  SpscRing<ActuationRecord, 64> & actuation() { return layout->actuation; }
+  SpscRing<ActuationSample, 256> & stream() { return layout->stream; }
+
+ private:
+  ShmChannelLayout *layout;
+  std::string name;
+  bool created;
+};
+
+#endif /* SHM_RING_H */
@@ -0,0 +1,90 @@
+#include "shm_transport.h"
+#include <algorithm>
+#include <thread>
+
+// Polls of an empty ring before yielding the core to other threads.
+static const unsigned spin_limit = 1 << 16;
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+static void to_telemetry(const TelemetryRecord & record, Telemetry & telemetry) {
+  size_t num_pts = std::min<size_t>(record.num_pts, shm_max_waypoints);
+  telemetry.ptsx.assign(record.ptsx, record.ptsx + num_pts);
+  telemetry.ptsy.assign(record.ptsy, record.ptsy + num_pts);
+  telemetry.x = record.x;
+  telemetry.y = record.y;
+  telemetry.psi = record.psi;
+  telemetry.speed = record.speed;
+}
+
+static void to_record(const Actuation & actuation, ActuationRecord & record) {
+  record.steering_angle = actuation.steering_angle;
+  record.throttle = actuation.throttle;
+  record.num_mpc = std::min(actuation.mpc_x.size(), shm_max_trajectory);
+  std::copy_n(actuation.mpc_x.begin(), record.num_mpc, record.mpc_x);
+  std::copy_n(actuation.mpc_y.begin(), record.num_mpc, record.mpc_y);
+  record.num_next = std::min(actuation.next_x.size(), shm_max_waypoints);
+  std::copy_n(actuation.next_x.begin(), record.num_next, record.next_x);
+  std::copy_n(actuation.next_y.begin(), record.num_next, record.next_y);
+}
+
+void serve_shm(ShmChannel & channel, Controller & controller, bool conflate,
+               ActuationStreamer *streamer, const std::atomic<bool> & stop) {
+  auto never_cancel = []() { return false; };
+
+  TelemetryRecord in;
+  ActuationRecord out;
+  Telemetry telemetry;
+  Actuation actuation;
+  unsigned idle = 0;
+
+  while (!stop.load(std::memory_order_relaxed)) {
+    bool popped = conflate ?
+      channel.telemetry().PopNewest(in) > 0 :
+      channel.telemetry().TryPop(in);
+    if (!popped) {
+      if (++idle < spin_limit) {
+        cpu_relax();
+      } else {
+        std::this_thread::yield();
+      }
+      continue;
+    }
+    idle = 0;
+
+    out.seq = in.seq;
+    out.telemetry_received_ns = shm_now_ns();
+    auto received = ActuationStreamer::clock::now();
+
+    to_telemetry(in, telemetry);
+    controller.Control(telemetry, never_cancel, actuation);
+    to_record(actuation, out);
+
+    if (streamer != nullptr && !actuation.steering_profile.empty()) {
+      streamer->Publish(ActuationProfile {
+        in.seq,
+        received + std::chrono::duration_cast<ActuationStreamer::clock::duration>(
+          std::chrono::duration<double>(actuation.profile_delay)),
+        actuation.profile_dt,
+        actuation.steering_profile,
+        actuation.throttle_profile});
+    }
+
+    // The producer is expected to keep up with one reply per telemetry.
+    // If it does not, wait rather than drop a reply.
+    out.sent_ns = shm_now_ns();
+    while (!channel.actuation().TryPush(out) && !stop.load(std::memory_order_relaxed)) {
+      std::this_thread::yield();
+    }
+    controller.RecordLatency((out.sent_ns - out.telemetry_received_ns) / 1e9);
+
+    // If the next telemetry has not arrived yet, solve ahead for it.
+    if (channel.telemetry().Empty()) {
+      controller.Speculate();
+    }
+  }
+}
@@ -0,0 +1,20 @@
+#ifndef SHM_TRANSPORT_H
+#define SHM_TRANSPORT_H
+
+#include <atomic>
+#include "actuation_stream.h"
+#include "controller.h"
+#include "shm_ring.h"
+
+// Serve one vehicle over a shared memory channel until `stop` is set.
+//
+// Busy polls the telemetry ring, so that a record is picked up within about a
+// microsecond of being pushed, at the cost of one core. In conflation mode, only
+// the newest of the pending records is solved.
+//
+// There is no artificial actuation latency: the producer is the actuator.
+// If `streamer` is not null, the actuation profile of each solve is published to it.
+void serve_shm(ShmChannel & channel, Controller & controller, bool conflate,
+               ActuationStreamer *streamer, const std::atomic<bool> & stop);
+
+#endif /* SHM_TRANSPORT_H */
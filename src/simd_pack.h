@@ -0,0 +1,122 @@
+#ifndef SIMD_PACK_H
+#define SIMD_PACK_H
+
+// `x` rounded to the nearest integer, for |x| < 2^51, by adding and subtracting 1.5 * 2^52,
+// which leaves no bits below the unit. Unlike std::floor, loops of it vectorize without
+// SSE4.1 or -fno-trapping-math. Must not be compiled with -ffast-math, which would fold it.
+inline double round_nearest(double x) {
+  const double shifter = 6755399441055744.0;
+  return (x + shifter) - shifter;
+}
+
+// The sine and cosine of `x`, with no branches or library calls, so that loops of them
+// vectorize. Accurate to about 1e-16 for |x| up to 1e6 or so.
+//
+// Reduces `x` by a multiple q of pi/2 in three parts (Cody-Waite), evaluates the Cephes
+// minimax polynomials on [-pi/4, pi/4], and picks and negates them by q mod 4.
+inline void sincos_poly(double x, double & sine, double & cosine) {
+  const double pio2_1 = 1.57079625129699707031;
+  const double pio2_2 = 7.54978941586159635335e-8;
+  const double pio2_3 = 5.39030285815811905290e-15;
+  double q = round_nearest(x * 0.636619772367581343076); // nearest x / (pi/2)
+  double r = ((x - q * pio2_1) - q * pio2_2) - q * pio2_3;
+  double r2 = r * r;
+  double s = r + r * r2 * (-1.66666666666666307295e-1 + r2 * (8.33333333332211858878e-3 +
+    r2 * (-1.98412698295895385996e-4 + r2 * (2.75573136213857245213e-6 +
+    r2 * (-2.50507477628578072866e-8 + r2 * 1.58962301576546568060e-10)))));
+  double c = 1 - 0.5 * r2 + r2 * r2 * (4.16666666666665929218e-2 +
+    r2 * (-1.38888888888730564116e-3 + r2 * (2.48015872888517045348e-5 +
+    r2 * (-2.75573141792967388112e-7 + r2 * (2.08757008419747316778e-9 +
+    r2 * -1.13585365213876817300e-11)))));
+  // Select by arithmetic rather than by comparisons, which would keep the compiler from
+  // vectorizing. Multiplying by 0 or 1 and adding 0 are exact. For an integer k,
+  // floor(k / 2) is the nearest integer to k / 2 - 1/4, which is never a tie.
+  double half = round_nearest(q * 0.5 - 0.25);
+  double odd = q - 2 * half; // 1 in quadrants 1 and 3
+  double sine_sign = 1 - 2 * (half - 2 * round_nearest(half * 0.5 - 0.25)); // -1 in 2 and 3
+  double next_half = round_nearest((q + 1) * 0.5 - 0.25);
+  // -1 in quadrants 1 and 2
+  double cosine_sign = 1 - 2 * (next_half - 2 * round_nearest(next_half * 0.5 - 0.25));
+  sine = sine_sign * (odd * c + (1 - odd) * s);
+  cosine = cosine_sign * (odd * s + (1 - odd) * c);
+}
+
+// N doubles operated on lane by lane, e.g. the states of N vehicles, so that scalar code
+// templated on its number type, such as `step` of vehicle_model.h, runs on N at once.
+// The loops are simple enough for the compiler to vectorize, to the width of the
+// instruction set it targets.
+template <int N>
+struct alignas(N * sizeof(double)) Pack {
+  static const int size = N;
+
+  double lane[N];
+
+  Pack() {}
+
+  // Broadcast, so that doubles mix with packs.
+  Pack(double value) {
+    for (int i = 0; i < N; i++) {
+      lane[i] = value;
+    }
+  }
+
+  static Pack Load(const double *values) {
+    Pack pack;
+    for (int i = 0; i < N; i++) {
+      pack.lane[i] = values[i];
+    }
+    return pack;
+  }
+
+  void Store(double *values) const {
+    for (int i = 0; i < N; i++) {
+      values[i] = lane[i];
+    }
+  }
+};
+
+typedef Pack<4> Pack4d; // one AVX2 register
+typedef Pack<8> Pack8d; // one AVX-512 register
+
+#define PACK_OPERATOR(op) \
+  template <int N> \
+  inline Pack<N> operator op(const Pack<N> & a, const Pack<N> & b) { \
+    Pack<N> result; \
+    for (int i = 0; i < N; i++) { \
+      result.lane[i] = a.lane[i] op b.lane[i]; \
+    } \
+    return result; \
+  } \
+  template <int N> \
+  inline Pack<N> operator op(const Pack<N> & a, double b) { return a op Pack<N>(b); } \
+  template <int N> \
+  inline Pack<N> operator op(double a, const Pack<N> & b) { return Pack<N>(a) op b; }
+
+PACK_OPERATOR(+)
+PACK_OPERATOR(-)
+PACK_OPERATOR(*)
+PACK_OPERATOR(/)
+
+#undef PACK_OPERATOR
+
+template <int N>
+inline Pack<N> sin(const Pack<N> & a) {
+  Pack<N> result;
+  for (int i = 0; i < N; i++) {
+    double unused;
+    sincos_poly(a.lane[i], result.lane[i], unused);
+  }
+  return result;
+}
+
+template <int N>
+inline Pack<N> cos(const Pack<N> & a) {
+  Pack<N> result;
+  for (int i = 0; i < N; i++) {
+    double unused;
+    sincos_poly(a.lane[i], unused, result.lane[i]);
+  }
+  return result;
+}
+
+#endif /* SIMD_PACK_H */
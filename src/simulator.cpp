@@ -0,0 +1,57 @@
+// Headless closed-loop simulator, which drives the controller without Unity.
+//
+// Integrates the vehicle model of vehicle_model.h around a waypoint file, sends the
+// controller the same telemetry events as the simulator (see DATA.md), with the 6
+// waypoints from the one behind the car, and applies each actuation after the
+// artificial latency. Time is virtual: the simulation never sleeps, so a lap takes as
+// long as its solves. Scores the laps by their time, the cross track error against the
+// track map of the waypoints, and the speed. See closed_loop.h.
+//
+// Usage: ./simulator [one|avg|iterative] [--waypoints CSV] [--laps N] [--latency-ms MS]
+//          [--telemetry-ms MS] [--max-time S] [--max-cte M] [--mpc KEY=VALUE,...]
+//          [--track-map FILE] [--speed-profile CSV] [--frenet] [--adaptive-delay]
+//          [--delay-quantile Q] [--speculate] [--incremental-fit]
+//          [--sensitivity-updates C] [--full-solve-interval K]
+
+#include <chrono>
+#include <iostream>
+#include "closed_loop.h"
+
+int main(int argc, char* argv[]) {
+  ClosedLoopFlags flags;
+  for (int i = 1; i < argc; i++) {
+    if (!flags.Parse(argc, argv, i)) {
+      std::cerr << "Unknown option " << argv[i] << std::endl;
+      return -1;
+    }
+  }
+
+  ClosedLoopTrack track;
+  TrackMap track_map;
+  if (!flags.Load(track, track_map)) {
+    return -1;
+  }
+
+  auto wall_start = std::chrono::steady_clock::now();
+  ClosedLoopResult result;
+  run_closed_loop(track, flags.run, result);
+  double wall_s = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - wall_start).count();
+
+  for (size_t i = 0; i < result.lap_times.size(); i++) {
+    std::cout << "Lap " << i + 1 << ": " << result.lap_times[i] << " s" << std::endl;
+  }
+  if (result.off_track) {
+    std::cout << "Off track at " << result.time << " s, " << result.distance << " m" << std::endl;
+  } else if (result.lap_times.size() < flags.run.laps) {
+    std::cout << "Timed out at " << result.time << " s, " << result.distance << " m" << std::endl;
+  }
+  std::cout << "cte (m): rms " << result.rms_cte << ", max " << result.max_cte << std::endl;
+  std::cout << "speed (mph): mean " << result.mean_speed << ", max " << result.max_speed
+    << std::endl;
+  std::cout << result.num_solves << " telemetry events, " << result.time << " s simulated in "
+    << wall_s << " s, solves (ms): mean " << result.mean_solve_time * 1000 << ", max "
+    << result.max_solve_time * 1000 << ", " << result.deadline_misses << " over the latency"
+    << std::endl;
+  return result.lap_times.size() == flags.run.laps ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+#include "solver_pool.h"
+#include <algorithm>
+
+// The pool and queue index of the worker running on this thread, if any.
+static thread_local const SolverPool *current_pool = nullptr;
+static thread_local size_t current_queue_i = 0;
+
+SolverPool::SolverPool(size_t num_threads, std::function<void(size_t)> on_thread_start) :
+  next_seq(0),
+  pending(0),
+  stopping(false),
+  on_thread_start(on_thread_start) {
+  for (size_t i = 0; i < num_threads; i++) {
+    queues.emplace_back(new Queue());
+  }
+  for (size_t i = 0; i < num_threads; i++) {
+    workers.emplace_back(&SolverPool::Work, this, i);
+  }
+}
+
+SolverPool::~SolverPool() {
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex);
+    stopping = true;
+  }
+  idle_cv.notify_all();
+  for (auto & worker : workers) {
+    worker.join();
+  }
+}
+
+void SolverPool::Submit(clock::time_point deadline, std::function<void()> job) {
+  uint64_t seq = next_seq++;
+  size_t queue_i = current_pool == this ? current_queue_i : seq % queues.size();
+
+  // Count the job before publishing it, so that a worker taking it never brings the
+  // count below the number of jobs in the queues, which idle workers sleep on.
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex);
+    pending++;
+  }
+  Queue & queue = *queues[queue_i];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.heap.push_back(Job {deadline, seq, std::move(job)});
+    std::push_heap(queue.heap.begin(), queue.heap.end(), Later());
+  }
+  idle_cv.notify_one();
+}
+
+bool SolverPool::Pop(size_t queue_i, Job & job) {
+  Queue & queue = *queues[queue_i];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.heap.empty()) {
+    return false;
+  }
+  std::pop_heap(queue.heap.begin(), queue.heap.end(), Later());
+  job = std::move(queue.heap.back());
+  queue.heap.pop_back();
+  return true;
+}
+
+bool SolverPool::Steal(size_t thief_i, Job & job) {
+  // Find the victim whose earliest job is the earliest, then try to take it.
+  // The victim may have run it meanwhile, in which case take its next earliest.
+  size_t victim_i = thief_i;
+  clock::time_point earliest = clock::time_point::max();
+  for (size_t i = 0; i < queues.size(); i++) {
+    if (i == thief_i) {
+      continue;
+    }
+    Queue & queue = *queues[i];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.heap.empty() && queue.heap.front().deadline <= earliest) {
+      earliest = queue.heap.front().deadline;
+      victim_i = i;
+    }
+  }
+  return victim_i != thief_i && Pop(victim_i, job);
+}
+
+void SolverPool::Work(size_t thread_i) {
+  current_pool = this;
+  current_queue_i = thread_i;
+  on_thread_start(thread_i);
+
+  while (true) {
+    Job job;
+    if (Pop(thread_i, job) || Steal(thread_i, job)) {
+      {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        pending--;
+      }
+      job.run();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(idle_mutex);
+    if (pending == 0) {
+      if (stopping) {
+        return;
+      }
+      idle_cv.wait(lock, [this]() { return stopping || pending > 0; });
+    }
+  }
+}
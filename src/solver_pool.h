@@ -0,0 +1,71 @@
+#ifndef SOLVER_POOL_H
+#define SOLVER_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads running solver jobs, earliest deadline first.
+//
+// Each worker has its own queue, ordered by deadline. A job submitted from a worker
+// goes to that worker's queue, and other jobs are spread over the queues in turn.
+// A worker runs the earliest job of its own queue, and when it has none, steals the
+// earliest job among the other queues, so that no worker idles while jobs wait.
+class SolverPool {
+ public:
+  typedef std::chrono::steady_clock clock;
+
+  // `on_thread_start` is called on each worker thread with its index in [0, num_threads),
+  // before it runs any job.
+  SolverPool(size_t num_threads, std::function<void(size_t)> on_thread_start);
+
+  // Finish the jobs already submitted, then join the workers.
+  virtual ~SolverPool();
+
+  void Submit(clock::time_point deadline, std::function<void()> job);
+
+  size_t size() const { return workers.size(); }
+
+ private:
+  struct Job {
+    clock::time_point deadline;
+    uint64_t seq; // breaks ties in submission order
+    std::function<void()> run;
+  };
+
+  // Orders a heap so that the earliest deadline is at the front.
+  struct Later {
+    bool operator()(const Job & a, const Job & b) const {
+      return a.deadline > b.deadline || (a.deadline == b.deadline && a.seq > b.seq);
+    }
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::vector<Job> heap;
+  };
+
+  void Work(size_t thread_i);
+  bool Pop(size_t queue_i, Job & job);
+  bool Steal(size_t thief_i, Job & job);
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::atomic<uint64_t> next_seq;
+
+  // Guards `pending` and `stopping`, which idle workers wait on.
+  std::mutex idle_mutex;
+  std::condition_variable idle_cv;
+  size_t pending;
+  bool stopping;
+
+  std::function<void(size_t)> on_thread_start;
+  std::vector<std::thread> workers;
+};
+
+#endif /* SOLVER_POOL_H */
@@ -0,0 +1,38 @@
+#include "speed_profile.h"
+#include <math.h>
+#include <algorithm>
+
+using std::vector;
+
+// The longitudinal acceleration left by the lateral acceleration of speed `v` in a
+// curve of curvature `curvature`.
+static double remaining_acc(double max_acc, double max_lateral_acc, double v, double curvature) {
+  double lateral = v * v * fabs(curvature) / max_lateral_acc;
+  return max_acc * sqrt(std::max(0.0, 1 - lateral * lateral));
+}
+
+vector<double> compute_speed_profile(const vector<double> & curvatures, double ds,
+                                     const VehicleLimits & limits) {
+  size_t n = curvatures.size();
+  vector<double> speeds(n);
+  for (size_t i = 0; i < n; i++) {
+    double curve_limit = sqrt(limits.max_lateral_acc / std::max(fabs(curvatures[i]), 1e-9));
+    speeds[i] = std::min(limits.max_speed, curve_limit);
+  }
+
+  // The track is a loop, so each pass goes around twice, for the constraints from
+  // the slowest curve to reach all the way around.
+  for (size_t k = 1; k < 2 * n; k++) {
+    size_t i = k % n;
+    size_t prev = (k - 1) % n;
+    double acc = remaining_acc(limits.max_acc, limits.max_lateral_acc, speeds[prev], curvatures[prev]);
+    speeds[i] = std::min(speeds[i], sqrt(speeds[prev] * speeds[prev] + 2 * acc * ds));
+  }
+  for (size_t k = 2 * n - 1; k-- > 0; ) {
+    size_t i = k % n;
+    size_t next = (k + 1) % n;
+    double dec = remaining_acc(limits.max_dec, limits.max_lateral_acc, speeds[next], curvatures[next]);
+    speeds[i] = std::min(speeds[i], sqrt(speeds[next] * speeds[next] + 2 * dec * ds));
+  }
+  return speeds;
+}
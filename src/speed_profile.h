@@ -0,0 +1,24 @@
+#ifndef SPEED_PROFILE_H
+#define SPEED_PROFILE_H
+
+#include <vector>
+
+// What the vehicle can do, for planning its target speed along a track.
+struct VehicleLimits {
+  double max_speed; // meter/sec
+  double max_lateral_acc; // meter/sec^2
+  double max_acc; // meter/sec^2
+  double max_dec; // meter/sec^2, positive
+};
+
+// The fastest speeds along a closed track, sampled every `ds` meters with the given
+// curvatures, within the limits of the vehicle.
+//
+// Each speed is first limited by the lateral acceleration in its curve. Then a forward
+// pass limits how fast the vehicle can speed up out of curves, and a backward pass how
+// fast it can slow down into them. Longitudinal acceleration shares the friction circle
+// with lateral acceleration, so that none is left at the limit of a curve.
+std::vector<double> compute_speed_profile(const std::vector<double> & curvatures, double ds,
+                                          const VehicleLimits & limits);
+
+#endif /* SPEED_PROFILE_H */
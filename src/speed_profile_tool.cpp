@@ -0,0 +1,68 @@
+// Offline speed profile of a track.
+//
+// Builds the track map of a waypoint file, computes the fastest speed at each of its
+// samples within the vehicle's limits, and writes a CSV of `s,x,y,curvature,speed`
+// rows, in meters and meter/sec, for `./mpc --speed-profile`.
+//
+// Usage: ./speed_profile <waypoints csv> <output csv>
+//          [--max-speed MPH] [--max-lateral-acc M/S^2] [--max-acc M/S^2] [--max-dec M/S^2]
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include "MPC.h"
+#include "speed_profile.h"
+#include "track_map.h"
+
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0] << " <waypoints csv> <output csv> [options]" << std::endl;
+    return -1;
+  }
+
+  // The model's acceleration actuation is at most 1 meter/sec^2 either way.
+  VehicleLimits limits {70 / mps_to_mph, 9, 1, 1};
+  for (int i = 3; i < argc; i++) {
+    if (strcmp(argv[i], "--max-speed") == 0 && i + 1 < argc) {
+      limits.max_speed = atof(argv[++i]) / mps_to_mph;
+    } else if (strcmp(argv[i], "--max-lateral-acc") == 0 && i + 1 < argc) {
+      limits.max_lateral_acc = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--max-acc") == 0 && i + 1 < argc) {
+      limits.max_acc = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--max-dec") == 0 && i + 1 < argc) {
+      limits.max_dec = atof(argv[++i]);
+    } else {
+      std::cerr << "Unknown option " << argv[i] << std::endl;
+      return -1;
+    }
+  }
+
+  TrackMap map;
+  if (!map.Load(argv[1])) {
+    return -1;
+  }
+
+  std::vector<double> curvatures(map.size());
+  for (size_t i = 0; i < map.size(); i++) {
+    curvatures[i] = map.At(i * map.resolution()).curvature;
+  }
+  std::vector<double> speeds = compute_speed_profile(curvatures, map.resolution(), limits);
+
+  std::ofstream out(argv[2]);
+  out.precision(10);
+  out << "s,x,y,curvature,speed" << std::endl;
+  double min_speed = limits.max_speed;
+  for (size_t i = 0; i < map.size(); i++) {
+    TrackPoint point = map.At(i * map.resolution());
+    out << point.s << "," << point.x << "," << point.y << "," << point.curvature << ","
+      << speeds[i] << std::endl;
+    min_speed = std::min(min_speed, speeds[i]);
+  }
+  if (!out) {
+    std::cerr << "Failed to write " << argv[2] << std::endl;
+    return -1;
+  }
+  std::cout << "Wrote " << map.size() << " samples over " << map.length() << " m, "
+    << "slowest " << min_speed * mps_to_mph << " mph" << std::endl;
+}
@@ -0,0 +1,228 @@
+// Parameter sweep of the MPC horizon and cost weights, in closed loop.
+//
+// Runs each configuration of a grid, or of a random search, through the headless
+// simulator (see closed_loop.h), on all cores, and writes a CSV table of the
+// configurations and their scores: laps done and mean lap time, cross track error,
+// speed, solve times, and how many solves took longer than the latency.
+//
+// Usage: ./sweep [simulator options] [--grid KEY=V1,V2,...]... [--random N]
+//          [--range KEY=LO:HI]... [--seed S] [--threads T] [--out CSV]
+//
+// The keys are those of `MPCConfig`, e.g. `N`, `dt` or `cte_weight`, and `--mpc` sets the
+// base configuration. Without `--random`, every combination of the `--grid` values
+// runs. With it, N configurations run, each with a random one of the values of each
+// `--grid` key, and a value drawn uniformly from each `--range`.
+
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MPC.h"
+#include "closed_loop.h"
+
+using std::string;
+using std::vector;
+
+struct GridAxis {
+  string key;
+  vector<double> values;
+};
+
+struct RangeAxis {
+  string key;
+  double low;
+  double high;
+};
+
+// Parse `KEY=V1,V2,...`.
+bool parse_grid_axis(const string & spec, GridAxis & axis) {
+  size_t equals = spec.find('=');
+  if (equals == string::npos) {
+    return false;
+  }
+  axis.key = spec.substr(0, equals);
+  const char *p = spec.c_str() + equals + 1;
+  while (true) {
+    char *end;
+    axis.values.push_back(strtod(p, &end));
+    if (end == p || (*end != ',' && *end != '\0')) {
+      return false;
+    }
+    if (*end == '\0') {
+      return true;
+    }
+    p = end + 1;
+  }
+}
+
+// Parse `KEY=LO:HI`.
+bool parse_range_axis(const string & spec, RangeAxis & axis) {
+  size_t equals = spec.find('=');
+  if (equals == string::npos) {
+    return false;
+  }
+  axis.key = spec.substr(0, equals);
+  const char *p = spec.c_str() + equals + 1;
+  char *end;
+  axis.low = strtod(p, &end);
+  if (end == p || *end != ':') {
+    return false;
+  }
+  p = end + 1;
+  axis.high = strtod(p, &end);
+  return end != p && *end == '\0' && axis.low <= axis.high;
+}
+
+int main(int argc, char* argv[]) {
+  ClosedLoopFlags flags;
+  vector<GridAxis> grid;
+  vector<RangeAxis> ranges;
+  size_t num_random = 0;
+  unsigned int seed = 1;
+  size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+  string out_path;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc) {
+      GridAxis axis;
+      if (!parse_grid_axis(argv[++i], axis)) {
+        std::cerr << "Invalid --grid " << argv[i] << std::endl;
+        return -1;
+      }
+      grid.push_back(axis);
+    } else if (strcmp(argv[i], "--range") == 0 && i + 1 < argc) {
+      RangeAxis axis;
+      if (!parse_range_axis(argv[++i], axis)) {
+        std::cerr << "Invalid --range " << argv[i] << std::endl;
+        return -1;
+      }
+      ranges.push_back(axis);
+    } else if (strcmp(argv[i], "--random") == 0 && i + 1 < argc) {
+      num_random = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      num_threads = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+      out_path = argv[++i];
+    } else if (!flags.Parse(argc, argv, i)) {
+      std::cerr << "Unknown option " << argv[i] << std::endl;
+      return -1;
+    }
+  }
+  if (!ranges.empty() && num_random == 0) {
+    std::cerr << "--range requires --random" << std::endl;
+    return -1;
+  }
+
+  ClosedLoopTrack track;
+  TrackMap track_map;
+  if (!flags.Load(track, track_map)) {
+    return -1;
+  }
+
+  // The configurations, each the base one with the values of the sweep set.
+  const MPCConfig & base = flags.run.controller.mpc;
+  vector<MPCConfig> configs;
+  auto set = [](MPCConfig & config, const string & key, double value) {
+    if (!config.Set(key, key == "N" ? round(value) : value)) {
+      std::cerr << "Invalid MPC setting: " << key << "=" << value << std::endl;
+      exit(-1);
+    }
+  };
+  if (num_random > 0) {
+    std::mt19937 random(seed);
+    for (size_t k = 0; k < num_random; k++) {
+      MPCConfig config = base;
+      for (const GridAxis & axis : grid) {
+        set(config, axis.key, axis.values[random() % axis.values.size()]);
+      }
+      for (const RangeAxis & axis : ranges) {
+        set(config, axis.key, std::uniform_real_distribution<double>(axis.low, axis.high)(random));
+      }
+      configs.push_back(config);
+    }
+  } else {
+    configs.push_back(base);
+    for (const GridAxis & axis : grid) {
+      vector<MPCConfig> product;
+      for (const MPCConfig & config : configs) {
+        for (double value : axis.values) {
+          product.push_back(config);
+          set(product.back(), axis.key, value);
+        }
+      }
+      configs.swap(product);
+    }
+  }
+
+  // Each worker runs one configuration at a time, with its own controller.
+  num_threads = std::min(num_threads, configs.size());
+  std::cerr << "Running " << configs.size() << " configurations on " << num_threads
+    << " threads" << std::endl;
+  vector<ClosedLoopResult> results(configs.size());
+  std::atomic<size_t> next_config(0);
+  std::mutex progress_mutex;
+  size_t num_done = 0;
+  MPC::SetupThreads(num_threads);
+  auto work = [&](size_t thread_i) {
+    MPC::SetThreadNumber(thread_i + 1);
+    for (size_t k = next_config++; k < configs.size(); k = next_config++) {
+      ClosedLoopOptions options = flags.run;
+      options.controller.mpc = configs[k];
+      run_closed_loop(track, options, results[k]);
+      std::lock_guard<std::mutex> lock(progress_mutex);
+      std::cerr << "\r" << ++num_done << "/" << configs.size() << std::flush;
+    }
+  };
+  vector<std::thread> workers;
+  for (size_t i = 0; i < num_threads; i++) {
+    workers.emplace_back(work, i);
+  }
+  for (auto & worker : workers) {
+    worker.join();
+  }
+  std::cerr << std::endl;
+
+  std::ofstream file;
+  if (!out_path.empty()) {
+    file.open(out_path);
+  }
+  std::ostream & out = out_path.empty() ? std::cout : file;
+  for (const string & key : MPCConfig::Keys()) {
+    out << key << ",";
+  }
+  out << "laps,mean_lap_time,off_track,distance,rms_cte,max_cte,mean_speed,max_speed,"
+    "mean_solve_ms,max_solve_ms,deadline_misses" << std::endl;
+  for (size_t k = 0; k < configs.size(); k++) {
+    for (double value : configs[k].Values()) {
+      out << value << ",";
+    }
+    const ClosedLoopResult & result = results[k];
+    size_t laps = result.lap_times.size();
+    double lap_time = 0;
+    for (double t : result.lap_times) {
+      lap_time += t / laps;
+    }
+    out << laps << ",";
+    if (laps > 0) {
+      out << lap_time;
+    }
+    out << "," << result.off_track << "," << result.distance << "," << result.rms_cte << ","
+      << result.max_cte << "," << result.mean_speed << "," << result.max_speed << ","
+      << result.mean_solve_time * 1000 << "," << result.max_solve_time * 1000 << ","
+      << result.deadline_misses << std::endl;
+  }
+  if (!out) {
+    std::cerr << "Failed to write " << out_path << std::endl;
+    return -1;
+  }
+}
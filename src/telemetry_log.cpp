@@ -0,0 +1,194 @@
+#include "telemetry_log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <iostream>
+
+using std::string;
+
+// Bytes of zeros that pad `size` to the alignment.
+static size_t padding(size_t size) {
+  return (telemetry_log_alignment - size % telemetry_log_alignment) % telemetry_log_alignment;
+}
+
+// Write all of `data`, across partial writes. Return false on an error.
+static bool write_all(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+TelemetryRecorder::TelemetryRecorder(size_t max_buffered) :
+  max_buffered(max_buffered),
+  fd(-1),
+  num_pending(0),
+  num_dropped(0),
+  stopping(false) {}
+
+TelemetryRecorder::~TelemetryRecorder() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  pending_cv.notify_all();
+  if (thread.joinable()) {
+    thread.join();
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+bool TelemetryRecorder::Open(const string & path, int argc, char* argv[]) {
+  fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if (fd < 0) {
+    std::cerr << "Failed to open " << path << std::endl;
+    return false;
+  }
+
+  string args;
+  for (int i = 0; i < argc; i++) {
+    args.append(argv[i], strlen(argv[i]) + 1);
+  }
+  TelemetryLogHeader header;
+  header.magic = telemetry_log_magic;
+  header.version = telemetry_log_version;
+  header.args_size = args.size();
+  args.append(padding(args.size()), '\0');
+  if (!write_all(fd, reinterpret_cast<const char *>(&header), sizeof(header)) ||
+      !write_all(fd, args.data(), args.size())) {
+    std::cerr << "Failed to write " << path << std::endl;
+    return false;
+  }
+
+  thread = std::thread(&TelemetryRecorder::Run, this);
+  return true;
+}
+
+void TelemetryRecorder::Append(const TelemetryLogRecord & record, const char *data) {
+  size_t size = sizeof(record) + record.data_size + padding(record.data_size);
+  std::lock_guard<std::mutex> lock(mutex);
+  if (pending.size() + size > max_buffered) {
+    num_dropped++;
+    return;
+  }
+  pending.append(reinterpret_cast<const char *>(&record), sizeof(record));
+  if (record.data_size > 0) {
+    pending.append(data, record.data_size);
+  }
+  pending.append(padding(record.data_size), '\0');
+  num_pending++;
+  // The writer only waits when nothing is pending.
+  if (num_pending == 1) {
+    pending_cv.notify_one();
+  }
+}
+
+size_t TelemetryRecorder::dropped() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return num_dropped;
+}
+
+void TelemetryRecorder::Run() {
+  string writing;
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    pending_cv.wait(lock, [this]() { return stopping || num_pending > 0; });
+    if (num_pending == 0) {
+      return;
+    }
+
+    // Write outside the lock, so that appending never waits on the disk.
+    writing.clear();
+    writing.swap(pending);
+    size_t num_writing = num_pending;
+    num_pending = 0;
+    lock.unlock();
+    bool written = write_all(fd, writing.data(), writing.size());
+    lock.lock();
+    if (!written) {
+      num_dropped += num_writing;
+    }
+  }
+}
+
+TelemetryLogReader::TelemetryLogReader() :
+  mapping(nullptr),
+  mapping_size(0),
+  offset(0) {}
+
+TelemetryLogReader::~TelemetryLogReader() {
+  if (mapping != nullptr) {
+    munmap(const_cast<char *>(mapping), mapping_size);
+  }
+}
+
+bool TelemetryLogReader::Open(const string & path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Failed to open " << path << std::endl;
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || (size_t) file_stat.st_size < sizeof(TelemetryLogHeader)) {
+    std::cerr << "Failed to read " << path << std::endl;
+    close(fd);
+    return false;
+  }
+  size_t size = file_stat.st_size;
+  void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    std::cerr << "Failed to map " << path << std::endl;
+    return false;
+  }
+  // The records are read once, in order.
+  madvise(addr, size, MADV_SEQUENTIAL);
+
+  const char *base = static_cast<const char *>(addr);
+  const TelemetryLogHeader & header = *reinterpret_cast<const TelemetryLogHeader *>(base);
+  size_t args_end = sizeof(header) + header.args_size;
+  if (header.magic != telemetry_log_magic || header.version != telemetry_log_version ||
+      header.args_size > size - sizeof(header) ||
+      (header.args_size > 0 && base[args_end - 1] != '\0')) {
+    std::cerr << path << " is not a telemetry log of version " << telemetry_log_version
+      << std::endl;
+    munmap(addr, size);
+    return false;
+  }
+
+  mapping = base;
+  mapping_size = size;
+  command_line.clear();
+  for (size_t i = sizeof(header); i < args_end; i += command_line.back().size() + 1) {
+    command_line.push_back(base + i);
+  }
+  offset = args_end + padding(header.args_size);
+  return true;
+}
+
+bool TelemetryLogReader::Next(const TelemetryLogRecord *& record, const char *& data) {
+  if (offset > mapping_size || mapping_size - offset < sizeof(TelemetryLogRecord)) {
+    return false;
+  }
+  record = reinterpret_cast<const TelemetryLogRecord *>(mapping + offset);
+  size_t data_offset = offset + sizeof(TelemetryLogRecord);
+  if (record->data_size > mapping_size - data_offset) {
+    return false;
+  }
+  data = mapping + data_offset;
+  offset = data_offset + record->data_size + padding(record->data_size);
+  return true;
+}
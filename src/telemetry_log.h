@@ -0,0 +1,136 @@
+#ifndef TELEMETRY_LOG_H
+#define TELEMETRY_LOG_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The binary format of a telemetry log, which `./mpc --record` appends to and the replay
+// tool maps read-only, to feed the recorded telemetry through the controller again.
+//
+// A header, then the server's command line, as NUL terminated arguments, then records,
+// each a fixed-layout `TelemetryLogRecord` followed by its frame's bytes, padded with
+// zeros to a multiple of `telemetry_log_alignment`, as is the command line. Times are
+// nanoseconds of the steady clock of the recording host. Files are read on hosts of the
+// same byte order as the one that wrote them, which the magic number checks.
+
+const uint32_t telemetry_log_magic = 0x474f4c54; // "TLOG"
+const uint32_t telemetry_log_version = 2;
+const uint64_t telemetry_log_alignment = 8;
+
+struct TelemetryLogHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t args_size; // bytes of the command line that follows
+};
+
+enum telemetry_log_record_type {
+  // A session's controller was created at `time`. Its actuation history starts then.
+  record_open = 1,
+  // A telemetry frame was received at `time`, and `Controller::Control` run on it.
+  record_telemetry = 2,
+  // An actuation of the session was sent `latency` seconds after its telemetry was
+  // received, and the controller told so, at `time`.
+  record_latency = 3,
+  // `Controller::Speculate` was run at `time`, after the session's last `record_telemetry`.
+  record_speculation = 4
+};
+
+struct TelemetryLogRecord {
+  uint32_t type;
+  uint32_t session;
+  int64_t time; // nanosecond
+  uint32_t data_size; // bytes of the frame that follow the record
+  uint8_t binary; // whether the frame is in the wire format of wire.h, else JSON
+  uint8_t solved; // whether `Control` returned true
+  // How many times `Control` polled for cancellation until it was told to cancel,
+  // or zero if it was not.
+  uint8_t cancel_polls;
+  uint8_t padding;
+  // By the controller's clock: when `Control` started, and committed its actuation.
+  int64_t control_start;
+  int64_t committed;
+  // The actuation, if solved, or the latency, in seconds, of a `record_latency`.
+  double steering_angle;
+  double throttle;
+  double latency;
+};
+
+// Nanoseconds since the steady clock's epoch, as the log stamps times.
+inline int64_t to_log_time(std::chrono::steady_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+inline std::chrono::steady_clock::time_point from_log_time(int64_t time) {
+  return std::chrono::steady_clock::time_point(
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::nanoseconds(time)));
+}
+
+// Appends records to a telemetry log on a background thread, so that the solver and
+// event loop threads only copy them into a buffer.
+//
+// If the disk falls behind by more than `max_buffered` bytes, records are dropped,
+// and counted, rather than buffered without bound.
+class TelemetryRecorder {
+ public:
+  explicit TelemetryRecorder(size_t max_buffered = 64 << 20);
+
+  // Write what is buffered, and join the writer thread.
+  virtual ~TelemetryRecorder();
+
+  // Create or truncate the log, and write its header with the command line.
+  // Return false if it cannot be written.
+  bool Open(const std::string & path, int argc, char* argv[]);
+
+  // Append a record, and `record.data_size` bytes of `data`. May be called from any thread.
+  void Append(const TelemetryLogRecord & record, const char *data = nullptr);
+
+  // Number of records dropped because the writer fell behind, or failed.
+  size_t dropped() const;
+
+ private:
+  void Run();
+
+  size_t max_buffered;
+  int fd;
+
+  // Guards `pending`, the counts and `stopping`.
+  mutable std::mutex mutex;
+  std::condition_variable pending_cv;
+  std::string pending;
+  size_t num_pending; // records in `pending`
+  size_t num_dropped;
+  bool stopping;
+
+  std::thread thread;
+};
+
+// A telemetry log mapped read-only. Walk the records with `Next`.
+class TelemetryLogReader {
+ public:
+  TelemetryLogReader();
+  virtual ~TelemetryLogReader();
+
+  // Map a log, and check its header. Return false if it is not a log of this version.
+  bool Open(const std::string & path);
+
+  // The command line of the recording server.
+  const std::vector<std::string> & args() const { return command_line; }
+
+  // Point `record` and `data` at the next record and its frame. Return false at the end
+  // of the log, or if the last record was cut short, e.g. by a crash.
+  bool Next(const TelemetryLogRecord *& record, const char *& data);
+
+ private:
+  const char *mapping;
+  size_t mapping_size;
+  size_t offset;
+  std::vector<std::string> command_line;
+};
+
+#endif /* TELEMETRY_LOG_H */
@@ -1,26 +1,10 @@
 #ifndef TOOLS_H
 #define TOOLS_H
 
+#include <chrono>
 #include <vector>
 #include "Eigen-3.3/Eigen/Core"
-
-// Affine
-Eigen::MatrixXd translate_then_rotate(
-  std::vector<double> & x, std::vector<double> & y,
-  double offset_x, double offset_y, double angle) {
-
-  size_t sz = x.size();
-
-  Eigen::MatrixXd translated(2, sz);
-  translated.row(0) = Eigen::Map<Eigen::VectorXd>(&x[0], sz) + Eigen::VectorXd::Ones(sz) * offset_x;
-  translated.row(1) = Eigen::Map<Eigen::VectorXd>(&y[0], sz) + Eigen::VectorXd::Ones(sz) * offset_y;
-
-  Eigen::MatrixXd rotator(2, 2);
-  rotator << cos(angle), -sin(angle),
-             sin(angle), cos(angle);
-
-  return rotator * translated;
-}
+#include "vehicle_model.h"
 
 // // Evaluate a polynomial.
 // double polyeval(const Eigen::VectorXd & coeffs, double x) {
@@ -40,33 +24,32 @@ Eigen::MatrixXd translate_then_rotate(
 //   return result;
 // }
 
-std::vector<double> global_kinetic_model(
+// The state (x, y, psi, v, cte, epsi) after `dt` seconds of the actuation.
+inline std::vector<double> global_kinetic_model(
   const std::vector<double> & state,
-  double steering, double throttle, double dt, double Lf) {
+  double steering, double throttle, double dt) {
 
-  double px = state[0];
-  double py = state[1];
-  double psi = state[2];
   double v = state[3];
   double cte = state[4];
   double epsi = state[5];
 
-  // double cte = polyeval(coeffs, px) - py;
-  // double epsi = psi - atan(dydx(coeffs, px));
-
-  double helper_psi_term = v / Lf * steering * dt;
-
-  double next_px = px + v * cos(psi) * dt;
-  double next_py = py + v * sin(psi) * dt;
-  double next_psi = psi + helper_psi_term;
-  double next_v = v + throttle * dt;
+  VehicleState<double> next = step(VehicleState<double> {state[0], state[1], state[2], v},
+                                   VehicleInput<double> {steering, throttle}, dt);
   double next_cte = cte + v * sin(epsi) * dt;
-  double next_epsi = epsi + helper_psi_term;
+  double next_epsi = epsi + yaw_rate(v, steering) * dt;
+
+  return std::vector<double> {next.x, next.y, next.psi, next.v, next_cte, next_epsi};
+}
 
-  return std::vector<double> {next_px, next_py, next_psi, next_v, next_cte, next_epsi};
+// The wall time since `mark`, in seconds. Then move `mark` to now.
+inline double lap(std::chrono::steady_clock::time_point & mark) {
+  auto now = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(now - mark).count();
+  mark = now;
+  return seconds;
 }
 
-std::vector<double> eigen_to_std_vector(Eigen::VectorXd eigen) {
+inline std::vector<double> eigen_to_std_vector(Eigen::VectorXd eigen) {
   auto begin = eigen.data();
   return std::vector<double>(begin, begin + eigen.size());
 }
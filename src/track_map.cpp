@@ -0,0 +1,531 @@
+#include "track_map.h"
+#include <fcntl.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "track_map_file.h"
+
+using std::string;
+using std::vector;
+
+// Second derivatives at the knots of the periodic cubic spline through `y`,
+// where knot i + 1 is `h[i]` after knot i, and knot n is knot 0.
+//
+// Solves the cyclic tridiagonal system
+//   h[i-1] m[i-1] + 2 (h[i-1] + h[i]) m[i] + h[i] m[i+1] = 6 (slope[i] - slope[i-1])
+// by the Thomas algorithm, with the corners handled by Sherman-Morrison.
+static vector<double> periodic_spline_moments(const vector<double> & h, const vector<double> & y) {
+  size_t n = y.size();
+  vector<double> lower(n), diag(n), upper(n), rhs(n);
+  for (size_t i = 0; i < n; i++) {
+    size_t prev = (i + n - 1) % n;
+    size_t next = (i + 1) % n;
+    lower[i] = h[prev];
+    diag[i] = 2 * (h[prev] + h[i]);
+    upper[i] = h[i];
+    rhs[i] = 6 * ((y[next] - y[i]) / h[i] - (y[i] - y[prev]) / h[prev]);
+  }
+
+  // A = B + u v', where B is tridiagonal, u = (gamma, 0, ..., 0, upper[n-1]),
+  // and v = (1, 0, ..., 0, lower[0] / gamma).
+  double corner_lower = upper[n - 1]; // A(n-1, 0)
+  double corner_upper = lower[0]; // A(0, n-1)
+  double gamma = -diag[0];
+  diag[0] -= gamma;
+  diag[n - 1] -= corner_lower * corner_upper / gamma;
+
+  auto solve_tridiagonal = [&](vector<double> d) {
+    vector<double> c(n), x(n);
+    c[0] = upper[0] / diag[0];
+    d[0] /= diag[0];
+    for (size_t i = 1; i < n; i++) {
+      double denom = diag[i] - lower[i] * c[i - 1];
+      c[i] = upper[i] / denom;
+      d[i] = (d[i] - lower[i] * d[i - 1]) / denom;
+    }
+    x[n - 1] = d[n - 1];
+    for (size_t i = n - 1; i-- > 0; ) {
+      x[i] = d[i] - c[i] * x[i + 1];
+    }
+    return x;
+  };
+
+  vector<double> u(n, 0);
+  u[0] = gamma;
+  u[n - 1] = corner_lower;
+  vector<double> x = solve_tridiagonal(rhs);
+  vector<double> z = solve_tridiagonal(u);
+  double v_x = x[0] + corner_upper / gamma * x[n - 1];
+  double v_z = z[0] + corner_upper / gamma * z[n - 1];
+  double factor = v_x / (1 + v_z);
+  for (size_t i = 0; i < n; i++) {
+    x[i] -= factor * z[i];
+  }
+  return x;
+}
+
+// One coordinate of a cubic spline segment: value and first two derivatives
+// at `t` from the start of a segment of length `h`.
+static void eval_segment(double y0, double y1, double m0, double m1, double h, double t,
+                         double & value, double & d1, double & d2) {
+  double b = (y1 - y0) / h - h * (2 * m0 + m1) / 6;
+  double c3 = (m1 - m0) / (6 * h);
+  value = y0 + t * (b + t * (m0 / 2 + t * c3));
+  d1 = b + t * (m0 + t * 3 * c3);
+  d2 = m0 + t * 6 * c3;
+}
+
+TrackMap::TrackMap(double resolution) :
+  ds(resolution),
+  track_length(0),
+  num_samples(0),
+  xs(nullptr),
+  ys(nullptr),
+  headings(nullptr),
+  curvatures(nullptr),
+  speeds(nullptr),
+  mapping(nullptr),
+  mapping_size(0) {}
+
+TrackMap::~TrackMap() {
+  Unmap();
+}
+
+bool TrackMap::Load(const string & path) {
+  // A compiled map starts with its magic number, and a CSV with its header.
+  std::ifstream csv(path, std::ios::binary);
+  uint32_t magic = 0;
+  csv.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+  if (csv && magic == track_map_magic) {
+    return Map(path);
+  }
+  csv.clear();
+  csv.seekg(0);
+
+  vector<double> waypoints_x, waypoints_y;
+  string line;
+  std::getline(csv, line); // header
+  for (size_t line_number = 2; std::getline(csv, line); line_number++) {
+    if (line.find_first_not_of(" \t\r") == string::npos) {
+      continue;
+    }
+    std::istringstream fields(line);
+    string x, y;
+    double wp_x, wp_y;
+    if (!std::getline(fields, x, ',') || !std::getline(fields, y, ',')
+        || !parse_csv_double(x, wp_x) || !parse_csv_double(y, wp_y)) {
+      std::cerr << "Malformed waypoint at " << path << ":" << line_number << std::endl;
+      return false;
+    }
+    waypoints_x.push_back(wp_x);
+    waypoints_y.push_back(wp_y);
+  }
+  if (!Build(waypoints_x, waypoints_y)) {
+    std::cerr << "Failed to build a track map from " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool TrackMap::Build(const vector<double> & waypoints_x, const vector<double> & waypoints_y) {
+  vector<double> knots_x, knots_y;
+  for (size_t i = 0; i < waypoints_x.size() && i < waypoints_y.size(); i++) {
+    // Skip repeated waypoints, including a last one that repeats the first.
+    size_t n = knots_x.size();
+    bool repeated = n > 0 && waypoints_x[i] == knots_x[n - 1] && waypoints_y[i] == knots_y[n - 1];
+    bool closes = i + 1 == waypoints_x.size() && n > 0 &&
+      waypoints_x[i] == knots_x[0] && waypoints_y[i] == knots_y[0];
+    if (!repeated && !closes) {
+      knots_x.push_back(waypoints_x[i]);
+      knots_y.push_back(waypoints_y[i]);
+    }
+  }
+  size_t n = knots_x.size();
+  if (n < 3) {
+    return false;
+  }
+
+  // Start with chord lengths between knots. Then re-fit with the arc lengths of the
+  // previous fit, by Gauss-Legendre quadrature, until the parameter is arc length.
+  vector<double> h(n);
+  for (size_t i = 0; i < n; i++) {
+    h[i] = hypot(knots_x[(i + 1) % n] - knots_x[i], knots_y[(i + 1) % n] - knots_y[i]);
+  }
+  vector<double> mx, my;
+  const double gauss_t[] = {-0.9061798459, -0.5384693101, 0, 0.5384693101, 0.9061798459};
+  const double gauss_w[] = {0.2369268851, 0.4786286705, 0.5688888889, 0.4786286705, 0.2369268851};
+  for (int iteration = 0; iteration < 4; iteration++) {
+    mx = periodic_spline_moments(h, knots_x);
+    my = periodic_spline_moments(h, knots_y);
+    if (iteration == 3) {
+      break;
+    }
+    vector<double> arc(n);
+    for (size_t i = 0; i < n; i++) {
+      size_t next = (i + 1) % n;
+      arc[i] = 0;
+      for (int q = 0; q < 5; q++) {
+        double t = h[i] * (gauss_t[q] + 1) / 2;
+        double x, dx, ddx, y, dy, ddy;
+        eval_segment(knots_x[i], knots_x[next], mx[i], mx[next], h[i], t, x, dx, ddx);
+        eval_segment(knots_y[i], knots_y[next], my[i], my[next], h[i], t, y, dy, ddy);
+        arc[i] += gauss_w[q] * hypot(dx, dy) * h[i] / 2;
+      }
+    }
+    h = arc;
+  }
+
+  track_length = 0;
+  for (size_t i = 0; i < n; i++) {
+    track_length += h[i];
+  }
+
+  // Sample the spline evenly, so that the loop is a whole number of samples.
+  Unmap();
+  num_samples = std::max<size_t>(n, (size_t) ceil(track_length / ds));
+  ds = track_length / num_samples;
+  x_storage.resize(num_samples);
+  y_storage.resize(num_samples);
+  heading_storage.resize(num_samples);
+  curvature_storage.resize(num_samples);
+  speed_storage.clear();
+
+  size_t segment = 0;
+  double segment_start = 0;
+  for (size_t k = 0; k < num_samples; k++) {
+    double s = k * ds;
+    while (segment + 1 < n && s >= segment_start + h[segment]) {
+      segment_start += h[segment];
+      segment++;
+    }
+    size_t next = (segment + 1) % n;
+    double t = s - segment_start;
+    double dx, ddx, dy, ddy;
+    eval_segment(knots_x[segment], knots_x[next], mx[segment], mx[next], h[segment], t,
+                 x_storage[k], dx, ddx);
+    eval_segment(knots_y[segment], knots_y[next], my[segment], my[next], h[segment], t,
+                 y_storage[k], dy, ddy);
+    heading_storage[k] = atan2(dy, dx);
+    curvature_storage[k] = (dx * ddy - dy * ddx) / pow(dx * dx + dy * dy, 1.5);
+  }
+
+  xs = x_storage.data();
+  ys = y_storage.data();
+  headings = heading_storage.data();
+  curvatures = curvature_storage.data();
+  speeds = nullptr;
+  spatial_index.Build(xs, ys, num_samples, true);
+  return true;
+}
+
+bool TrackMap::Save(const string & path) const {
+  if (num_samples == 0) {
+    std::cerr << "No track map to save" << std::endl;
+    return false;
+  }
+
+  TrackMapFileHeader header = TrackMapFileHeader();
+  header.magic = track_map_magic;
+  header.version = track_map_version;
+  header.num_samples = num_samples;
+  header.resolution = ds;
+  header.length = track_length;
+  PolylineIndex::Grid grid = spatial_index.grid();
+  header.cell_size = grid.cell_size;
+  header.min_x = grid.min_x;
+  header.min_y = grid.min_y;
+  header.num_x = grid.num_x;
+  header.num_y = grid.num_y;
+  header.num_cell_segments = spatial_index.num_cell_segments();
+
+  vector<double> arc_lengths(num_samples);
+  for (size_t i = 0; i < num_samples; i++) {
+    arc_lengths[i] = i * ds;
+  }
+  const void *data[num_track_map_sections] = {
+    xs, ys, arc_lengths.data(), headings, curvatures, speeds,
+    spatial_index.cell_start(), spatial_index.cell_segments()};
+  uint64_t table_size = num_samples * sizeof(double);
+  header.section_size[section_x] = table_size;
+  header.section_size[section_y] = table_size;
+  header.section_size[section_s] = table_size;
+  header.section_size[section_heading] = table_size;
+  header.section_size[section_curvature] = table_size;
+  header.section_size[section_speed] = speeds != nullptr ? table_size : 0;
+  header.section_size[section_cell_start] = (spatial_index.num_cells() + 1) * sizeof(uint32_t);
+  header.section_size[section_cell_segments] = header.num_cell_segments * sizeof(uint32_t);
+
+  auto align = [](uint64_t offset) {
+    return (offset + track_map_alignment - 1) / track_map_alignment * track_map_alignment;
+  };
+  uint64_t offset = align(sizeof(header));
+  for (int section = 0; section < num_track_map_sections; section++) {
+    header.section_offset[section] = offset;
+    offset = align(offset + header.section_size[section]);
+  }
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  for (int section = 0; section < num_track_map_sections; section++) {
+    // Pad with zeros up to the section.
+    std::string padding(header.section_offset[section] - out.tellp(), '\0');
+    out.write(padding.data(), padding.size());
+    out.write(static_cast<const char *>(data[section]), header.section_size[section]);
+  }
+  if (!out) {
+    std::cerr << "Failed to write " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool TrackMap::Map(const string & path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Failed to open " << path << std::endl;
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || (size_t) file_stat.st_size < sizeof(TrackMapFileHeader)) {
+    std::cerr << "Failed to read " << path << std::endl;
+    close(fd);
+    return false;
+  }
+  size_t size = file_stat.st_size;
+  void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    std::cerr << "Failed to map " << path << std::endl;
+    return false;
+  }
+
+  // Check that the sections are where they fit, before reading any of them, and that
+  // the sizes they are checked against do not overflow.
+  const char *base = static_cast<const char *>(addr);
+  const TrackMapFileHeader & header = *reinterpret_cast<const TrackMapFileHeader *>(base);
+  const uint64_t max_count = size / sizeof(uint32_t);
+  bool valid = header.magic == track_map_magic && header.version == track_map_version &&
+    header.num_samples >= 3 && header.num_samples <= max_count &&
+    header.num_cell_segments <= max_count &&
+    header.num_x > 0 && header.num_y > 0 && (uint64_t) header.num_x <= max_count &&
+    (uint64_t) header.num_y <= max_count / header.num_x &&
+    isfinite(header.resolution) && header.resolution > 0 &&
+    isfinite(header.length) && header.length > 0 &&
+    isfinite(header.cell_size) && header.cell_size > 0 &&
+    isfinite(header.min_x) && isfinite(header.min_y);
+  uint64_t table_size = valid ? header.num_samples * sizeof(double) : 0;
+  uint64_t num_cells = valid ? header.num_x * header.num_y : 0;
+  valid = valid &&
+    header.section_size[section_cell_start] == (num_cells + 1) * sizeof(uint32_t) &&
+    header.section_size[section_cell_segments] == header.num_cell_segments * sizeof(uint32_t) &&
+    (header.section_size[section_speed] == 0 || header.section_size[section_speed] == table_size);
+  for (int section = 0; valid && section < num_track_map_sections; section++) {
+    uint64_t offset = header.section_offset[section];
+    uint64_t section_size = header.section_size[section];
+    valid = offset % track_map_alignment == 0 && offset <= size && section_size <= size - offset &&
+      (section_size == table_size || section == section_speed ||
+       section == section_cell_start || section == section_cell_segments);
+  }
+
+  // Check that the spatial index only refers to its own entries, and to samples.
+  const uint32_t *cell_start =
+    reinterpret_cast<const uint32_t *>(base + header.section_offset[section_cell_start]);
+  const uint32_t *cell_segments =
+    reinterpret_cast<const uint32_t *>(base + header.section_offset[section_cell_segments]);
+  if (valid) {
+    valid = cell_start[0] == 0 && cell_start[num_cells] == header.num_cell_segments;
+    for (uint64_t c = 0; valid && c < num_cells; c++) {
+      valid = cell_start[c] <= cell_start[c + 1];
+    }
+    for (uint64_t k = 0; valid && k < header.num_cell_segments; k++) {
+      valid = cell_segments[k] < header.num_samples;
+    }
+  }
+  if (!valid) {
+    std::cerr << path << " is not a track map of version " << track_map_version << std::endl;
+    munmap(addr, size);
+    return false;
+  }
+
+  Unmap();
+  mapping = addr;
+  mapping_size = size;
+  auto table = [base, &header](track_map_section section) {
+    return reinterpret_cast<const double *>(base + header.section_offset[section]);
+  };
+  num_samples = header.num_samples;
+  ds = header.resolution;
+  track_length = header.length;
+  xs = table(section_x);
+  ys = table(section_y);
+  headings = table(section_heading);
+  curvatures = table(section_curvature);
+  speeds = header.section_size[section_speed] > 0 ? table(section_speed) : nullptr;
+  x_storage.clear();
+  y_storage.clear();
+  heading_storage.clear();
+  curvature_storage.clear();
+  speed_storage.clear();
+
+  PolylineIndex::Grid grid {
+    header.cell_size, header.min_x, header.min_y, header.num_x, header.num_y};
+  spatial_index.Attach(xs, ys, num_samples, true, grid, cell_start, cell_segments);
+  return true;
+}
+
+void TrackMap::Unmap() {
+  if (mapping != nullptr) {
+    munmap(mapping, mapping_size);
+    mapping = nullptr;
+    mapping_size = 0;
+  }
+}
+
+TrackPoint TrackMap::At(double s) const {
+  s = fmod(s, track_length);
+  if (s < 0) {
+    s += track_length;
+  }
+  size_t i = std::min((size_t) (s / ds), num_samples - 1);
+  size_t next = (i + 1) % num_samples;
+  double frac = s / ds - i;
+
+  // Interpolate the heading by its change, which is small, so as not to cross the branch cut.
+  double dheading = headings[next] - headings[i];
+  dheading = atan2(sin(dheading), cos(dheading));
+
+  return TrackPoint {
+    s,
+    xs[i] + (xs[next] - xs[i]) * frac,
+    ys[i] + (ys[next] - ys[i]) * frac,
+    headings[i] + dheading * frac,
+    curvatures[i] + (curvatures[next] - curvatures[i]) * frac};
+}
+
+bool TrackMap::LoadSpeeds(const string & csv_path) {
+  std::ifstream csv(csv_path);
+  string line;
+  std::getline(csv, line);
+
+  // Find the columns by the header.
+  int s_column = -1;
+  int speed_column = -1;
+  {
+    std::istringstream fields(line);
+    string field;
+    for (int column = 0; std::getline(fields, field, ','); column++) {
+      if (field == "s") {
+        s_column = column;
+      } else if (field == "speed") {
+        speed_column = column;
+      }
+    }
+  }
+  if (s_column < 0 || speed_column < 0) {
+    std::cerr << "No s and speed columns in " << csv_path << std::endl;
+    return false;
+  }
+
+  vector<double> profile_s, profile_speed;
+  for (size_t line_number = 2; std::getline(csv, line); line_number++) {
+    if (line.find_first_not_of(" \t\r") == string::npos) {
+      continue;
+    }
+    std::istringstream fields(line);
+    string field;
+    double s = NAN;
+    double speed = NAN;
+    int num_parsed = 0;
+    for (int column = 0; std::getline(fields, field, ','); column++) {
+      if (column == s_column || column == speed_column) {
+        num_parsed += parse_csv_double(field, column == s_column ? s : speed);
+      }
+    }
+    if (num_parsed < 2) {
+      std::cerr << "Malformed speed at " << csv_path << ":" << line_number << std::endl;
+      return false;
+    }
+    if (!isnan(s) && !isnan(speed) && (profile_s.empty() || s > profile_s.back())) {
+      profile_s.push_back(s);
+      profile_speed.push_back(speed);
+    }
+  }
+  if (profile_s.empty() || num_samples == 0) {
+    std::cerr << "Failed to load speeds from " << csv_path << std::endl;
+    return false;
+  }
+
+  // Interpolate linearly, around the loop past the last row.
+  vector<double> sample_speeds(num_samples);
+  size_t j = 0;
+  for (size_t k = 0; k < num_samples; k++) {
+    double s = k * ds;
+    while (j + 1 < profile_s.size() && profile_s[j + 1] <= s) {
+      j++;
+    }
+    double s0 = profile_s[j];
+    double s1 = j + 1 < profile_s.size() ? profile_s[j + 1] : profile_s[0] + track_length;
+    double v1 = j + 1 < profile_s.size() ? profile_speed[j + 1] : profile_speed[0];
+    double frac = s1 > s0 ? std::max(0.0, std::min(1.0, (s - s0) / (s1 - s0))) : 0;
+    sample_speeds[k] = profile_speed[j] + (v1 - profile_speed[j]) * frac;
+  }
+  SetSpeeds(sample_speeds);
+  return true;
+}
+
+void TrackMap::SetSpeeds(const vector<double> & sample_speeds) {
+  speed_storage = sample_speeds;
+  speed_storage.resize(num_samples, 0);
+  speeds = speed_storage.data();
+}
+
+double TrackMap::SpeedAt(double s) const {
+  s = fmod(s, track_length);
+  if (s < 0) {
+    s += track_length;
+  }
+  size_t i = std::min((size_t) (s / ds), num_samples - 1);
+  size_t next = (i + 1) % num_samples;
+  return speeds[i] + (speeds[next] - speeds[i]) * (s / ds - i);
+}
+
+void TrackMap::Project(double x, double y, size_t & hint, double & s, double & offset) const {
+  double t, distance_squared;
+  size_t i = spatial_index.Nearest(x, y, hint, t, distance_squared);
+  hint = i;
+
+  size_t next = (i + 1) % num_samples;
+  double cx = xs[next] - xs[i];
+  double cy = ys[next] - ys[i];
+  s = fmod((i + t) * ds, track_length);
+  offset = (cx * (y - ys[i]) - cy * (x - xs[i])) / hypot(cx, cy);
+}
+
+void TrackMap::Lookahead(double s, double distance, vector<TrackPoint> & points) const {
+  size_t num_points = (size_t) (distance / ds) + 1;
+  points.resize(num_points);
+  for (size_t k = 0; k < num_points; k++) {
+    points[k] = At(s + k * ds);
+    points[k].s = s + k * ds;
+  }
+}
+
+bool parse_csv_double(const string & field, double & value) {
+  const char *p = field.c_str();
+  char *end;
+  value = strtod(p, &end);
+  if (end == p) {
+    return false;
+  }
+  while (isspace(static_cast<unsigned char>(*end))) {
+    end++;
+  }
+  return *end == '\0';
+}
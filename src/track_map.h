@@ -0,0 +1,116 @@
+#ifndef TRACK_MAP_H
+#define TRACK_MAP_H
+
+#include <string>
+#include <vector>
+#include "polyline_index.h"
+
+// A point of the track centerline.
+struct TrackPoint {
+  double s; // arc length from the first waypoint, meter
+  double x;
+  double y;
+  double heading; // radian
+  double curvature; // 1/meter, positive when turning left
+};
+
+// The centerline of a closed track, in the global coordinate system.
+//
+// Built once from the global waypoints, as a periodic cubic spline parametrized by arc
+// length, then sampled into tables of position, heading and curvature at a fixed
+// arc length resolution. Queries are table lookups, with no fitting per telemetry event.
+//
+// The tables and the spatial index can be saved to a compiled map file, which later loads
+// by mapping it, with no fitting at all. See track_map_file.h.
+class TrackMap {
+ public:
+  // For `Project`, when there is no previous projection of the vehicle.
+  static const size_t no_hint = PolylineIndex::no_hint;
+
+  // `resolution` is the approximate arc length between table samples, in meters.
+  explicit TrackMap(double resolution = 0.5);
+
+  // The spatial index refers to the tables.
+  TrackMap(const TrackMap &) = delete;
+  TrackMap & operator=(const TrackMap &) = delete;
+
+  virtual ~TrackMap();
+
+  // Map a compiled map file read-only, or else build from a CSV file with an `x,y` header,
+  // such as lake_track_waypoints.csv.
+  bool Load(const std::string & path);
+
+  // Write a compiled map file, of the tables including speeds, if any, and the spatial index.
+  bool Save(const std::string & path) const;
+
+  // Build from waypoints in driving order. The last one connects back to the first.
+  bool Build(const std::vector<double> & waypoints_x, const std::vector<double> & waypoints_y);
+
+  // Total arc length of the loop, in meters.
+  double length() const { return track_length; }
+
+  // Number of table samples, and the arc length between two of them.
+  size_t size() const { return num_samples; }
+  double resolution() const { return ds; }
+
+  // The centerline at arc length `s`, interpolated between table samples.
+  // `s` may be outside [0, length), and is wrapped around the loop.
+  TrackPoint At(double s) const;
+
+  // Project a position onto the centerline. Output its arc length, and its signed lateral
+  // offset from the centerline, positive to the left.
+  //
+  // `hint` is from the vehicle's previous projection, and is updated for the next one.
+  // See `PolylineIndex::Nearest`.
+  void Project(double x, double y, size_t & hint, double & s, double & offset) const;
+
+  // Load target speeds from a CSV with `s` and `speed` columns, such as the speed_profile
+  // tool writes, and resample them to the table. They replace those of a compiled map.
+  bool LoadSpeeds(const std::string & csv_path);
+
+  // Set the target speed of each table sample, in meter/sec.
+  void SetSpeeds(const std::vector<double> & sample_speeds);
+
+  bool has_speeds() const { return speeds != nullptr; }
+
+  // The target speed at arc length `s`, in meter/sec. Requires speeds.
+  double SpeedAt(double s) const;
+
+  // The centerline for `distance` meters ahead of arc length `s`, every `resolution()`.
+  void Lookahead(double s, double distance, std::vector<TrackPoint> & points) const;
+
+  // The index of the polyline through the table samples.
+  const PolylineIndex & index() const { return spatial_index; }
+
+ protected:
+  bool Map(const std::string & path);
+  void Unmap();
+
+  double ds;
+  double track_length;
+  size_t num_samples;
+
+  // Sample i is at arc length i * ds. The tables point into the storage below, or into
+  // the mapped file.
+  const double *xs;
+  const double *ys;
+  const double *headings;
+  const double *curvatures;
+  const double *speeds; // null unless loaded
+  std::vector<double> x_storage;
+  std::vector<double> y_storage;
+  std::vector<double> heading_storage;
+  std::vector<double> curvature_storage;
+  std::vector<double> speed_storage;
+
+  void *mapping;
+  size_t mapping_size;
+
+  PolylineIndex spatial_index;
+};
+
+// Parse a CSV field as a number, with optional surrounding whitespace. Returns false on
+// a blank or malformed field.
+bool parse_csv_double(const std::string & field, double & value);
+
+#endif /* TRACK_MAP_H */
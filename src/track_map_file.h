@@ -0,0 +1,52 @@
+#ifndef TRACK_MAP_FILE_H
+#define TRACK_MAP_FILE_H
+
+#include <cstdint>
+
+// The binary format of a compiled track map, which the map_compiler tool writes from a
+// waypoint file and `TrackMap::Load` maps read-only, so that loading costs no parsing or
+// fitting, and processes on one host share the pages of the file.
+//
+// A header, then structure-of-arrays sections of native doubles and integers, each at
+// an offset that is a multiple of `track_map_alignment`. The tables of position, arc
+// length, heading, curvature and speed have one value per sample; the spatial index is
+// that of `PolylineIndex` over the samples. Files are read on hosts of the same
+// byte order as the one that wrote them, which the magic number checks.
+
+const uint32_t track_map_magic = 0x50414d54; // "TMAP"
+const uint32_t track_map_version = 1;
+const uint64_t track_map_alignment = 64;
+
+enum track_map_section {
+  section_x, // double per sample, meter
+  section_y,
+  section_s, // double per sample, meter; i * resolution, for readers other than `TrackMap`
+  section_heading, // double per sample, radian
+  section_curvature, // double per sample, 1/meter
+  section_speed, // double per sample, meter/sec; empty if the map has no speeds
+  section_cell_start, // uint32 per cell, plus one
+  section_cell_segments, // uint32 per entry
+  num_track_map_sections
+};
+
+struct TrackMapFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t num_samples;
+  double resolution; // meter
+  double length; // meter
+
+  // See `PolylineIndex::Grid`.
+  double cell_size;
+  double min_x;
+  double min_y;
+  int64_t num_x;
+  int64_t num_y;
+  uint64_t num_cell_segments;
+
+  // In bytes, from the start of the file.
+  uint64_t section_offset[num_track_map_sections];
+  uint64_t section_size[num_track_map_sections];
+};
+
+#endif /* TRACK_MAP_FILE_H */
@@ -0,0 +1,57 @@
+#ifndef VEHICLE_MODEL_H
+#define VEHICLE_MODEL_H
+
+#include <cmath>
+
+// This value assumes the model presented in the classroom is used.
+//
+// It was obtained by measuring the radius formed by running the vehicle in the
+// simulator around in a circle with a constant steering angle and velocity on a
+// flat terrain.
+//
+// Lf was tuned until the the radius formed by the simulating the model
+// presented in the classroom matched the previous radius.
+//
+// This is the length from front to CoG that has a similar radius.
+const double Lf = 2.67; // meter
+
+// The kinematic bicycle model, written once for every scalar type it is evaluated with:
+// double, `CppAD::AD<double>` in the solver, or a pack of several vehicles such as
+// `Pack4d`. The type needs arithmetic operators, also with doubles, and `sin` and `cos`,
+// either in std or found by argument-dependent lookup.
+
+template <class Scalar>
+struct VehicleState {
+  Scalar x;
+  Scalar y;
+  Scalar psi; // radian
+  Scalar v; // meter/sec
+};
+
+template <class Scalar>
+struct VehicleInput {
+  Scalar steering; // radian, positive values for left turn
+  Scalar acceleration; // meter/sec^2
+};
+
+// How fast the heading changes, in radian/sec.
+template <class Scalar>
+inline Scalar yaw_rate(const Scalar & v, const Scalar & steering) {
+  return v * steering / Lf;
+}
+
+// The state `dt` seconds later, with the input held, by one Euler step.
+template <class Scalar>
+inline VehicleState<Scalar> step(const VehicleState<Scalar> & state,
+                                 const VehicleInput<Scalar> & input, const Scalar & dt) {
+  using std::cos;
+  using std::sin;
+  VehicleState<Scalar> next;
+  next.x = state.x + state.v * cos(state.psi) * dt;
+  next.y = state.y + state.v * sin(state.psi) * dt;
+  next.psi = state.psi + yaw_rate(state.v, input.steering) * dt;
+  next.v = state.v + input.acceleration * dt;
+  return next;
+}
+
+#endif /* VEHICLE_MODEL_H */
@@ -0,0 +1,194 @@
+#include "wire.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "json.hpp"
+
+using std::string;
+using std::vector;
+using json = nlohmann::json;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define WIRE_SWAP_BYTES 1
+#endif
+
+void parse_telemetry_json(const string & event, Telemetry & telemetry) {
+  // j[1] is the data JSON object
+  auto j = json::parse(event);
+  telemetry.ptsx = j[1]["ptsx"].get<vector<double>>();
+  telemetry.ptsy = j[1]["ptsy"].get<vector<double>>();
+  telemetry.x = j[1]["x"];
+  telemetry.y = j[1]["y"];
+  telemetry.psi = j[1]["psi"];
+  telemetry.speed = j[1]["speed"];
+}
+
+string format_steer_json(const Actuation & actuation) {
+  json msgJson;
+  msgJson["steering_angle"] = actuation.steering_angle;
+  msgJson["throttle"] = actuation.throttle;
+
+  //Display the MPC predicted trajectory. Displayed in green line.
+  msgJson["mpc_x"] = actuation.mpc_x;
+  msgJson["mpc_y"] = actuation.mpc_y;
+
+  //Display the waypoints/reference line.  Displayed in yellow line.
+  msgJson["next_x"] = actuation.next_x;
+  msgJson["next_y"] = actuation.next_y;
+
+  return "42[\"steer\"," + msgJson.dump() + "]";
+}
+
+namespace {
+
+template <class T>
+void put(string & out, T value) {
+  char bytes[sizeof(T)];
+  memcpy(bytes, &value, sizeof(T));
+#ifdef WIRE_SWAP_BYTES
+  std::reverse(bytes, bytes + sizeof(T));
+#endif
+  out.append(bytes, sizeof(T));
+}
+
+// Reads fields in order, and remembers whether it ran past the end.
+class Reader {
+ public:
+  Reader(const char *data, size_t length) : p(data), end(data + length), ok(true) {}
+
+  template <class T>
+  T get() {
+    T value = T();
+    if (!ok || (size_t) (end - p) < sizeof(T)) {
+      ok = false;
+      return value;
+    }
+    char bytes[sizeof(T)];
+    memcpy(bytes, p, sizeof(T));
+#ifdef WIRE_SWAP_BYTES
+    std::reverse(bytes, bytes + sizeof(T));
+#endif
+    memcpy(&value, bytes, sizeof(T));
+    p += sizeof(T);
+    return value;
+  }
+
+  // Read an array of `n` elements of type `T` into `values`.
+  template <class T>
+  void get_array(uint32_t n, vector<double> & values) {
+    if (!ok || (size_t) (end - p) / sizeof(T) < n) {
+      ok = false;
+      return;
+    }
+    values.resize(n);
+    for (uint32_t i = 0; i < n; i++) {
+      values[i] = get<T>();
+    }
+  }
+
+  bool done() const { return ok && p == end; }
+  bool good() const { return ok; }
+
+ private:
+  const char *p;
+  const char *end;
+  bool ok;
+};
+
+void put_header(string & out, uint8_t type) {
+  put<uint16_t>(out, wire_magic);
+  put<uint8_t>(out, wire_version);
+  put<uint8_t>(out, type);
+}
+
+bool get_header(Reader & reader, uint8_t type) {
+  return reader.get<uint16_t>() == wire_magic &&
+    reader.get<uint8_t>() == wire_version &&
+    reader.get<uint8_t>() == type &&
+    reader.good();
+}
+
+} // namespace
+
+bool is_binary_message(const char *data, size_t length) {
+  Reader reader(data, length);
+  return reader.get<uint16_t>() == wire_magic && reader.good();
+}
+
+bool decode_telemetry(const char *data, size_t length, Telemetry & telemetry) {
+  Reader reader(data, length);
+  if (!get_header(reader, wire_type_telemetry)) {
+    return false;
+  }
+  telemetry.x = reader.get<double>();
+  telemetry.y = reader.get<double>();
+  telemetry.psi = reader.get<double>();
+  telemetry.speed = reader.get<double>();
+  reader.get<double>(); // steering_angle, not used by the controller
+  reader.get<double>(); // throttle, ditto
+  uint32_t n = reader.get<uint32_t>();
+  reader.get_array<double>(n, telemetry.ptsx);
+  reader.get_array<double>(n, telemetry.ptsy);
+  return reader.done();
+}
+
+void encode_telemetry(const Telemetry & telemetry, string & out) {
+  out.clear();
+  out.reserve(4 + 6 * sizeof(double) + 4 + 2 * telemetry.ptsx.size() * sizeof(double));
+  put_header(out, wire_type_telemetry);
+  put<double>(out, telemetry.x);
+  put<double>(out, telemetry.y);
+  put<double>(out, telemetry.psi);
+  put<double>(out, telemetry.speed);
+  put<double>(out, 0); // steering_angle
+  put<double>(out, 0); // throttle
+  uint32_t n = telemetry.ptsx.size();
+  put<uint32_t>(out, n);
+  for (uint32_t i = 0; i < n; i++) {
+    put<double>(out, telemetry.ptsx[i]);
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    put<double>(out, telemetry.ptsy[i]);
+  }
+}
+
+bool decode_steer(const char *data, size_t length, Actuation & actuation) {
+  Reader reader(data, length);
+  if (!get_header(reader, wire_type_steer)) {
+    return false;
+  }
+  actuation.steering_angle = reader.get<double>();
+  actuation.throttle = reader.get<double>();
+  uint32_t m = reader.get<uint32_t>();
+  reader.get_array<float>(m, actuation.mpc_x);
+  reader.get_array<float>(m, actuation.mpc_y);
+  uint32_t n = reader.get<uint32_t>();
+  reader.get_array<float>(n, actuation.next_x);
+  reader.get_array<float>(n, actuation.next_y);
+  return reader.done();
+}
+
+void encode_steer(const Actuation & actuation, string & out) {
+  out.clear();
+  out.reserve(4 + 2 * sizeof(double) + 8 +
+              2 * (actuation.mpc_x.size() + actuation.next_x.size()) * sizeof(float));
+  put_header(out, wire_type_steer);
+  put<double>(out, actuation.steering_angle);
+  put<double>(out, actuation.throttle);
+  uint32_t m = actuation.mpc_x.size();
+  put<uint32_t>(out, m);
+  for (uint32_t i = 0; i < m; i++) {
+    put<float>(out, actuation.mpc_x[i]);
+  }
+  for (uint32_t i = 0; i < m; i++) {
+    put<float>(out, actuation.mpc_y[i]);
+  }
+  uint32_t n = actuation.next_x.size();
+  put<uint32_t>(out, n);
+  for (uint32_t i = 0; i < n; i++) {
+    put<float>(out, actuation.next_x[i]);
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    put<float>(out, actuation.next_y[i]);
+  }
+}
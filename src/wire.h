@@ -0,0 +1,49 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "controller.h"
+
+// Encoding of telemetry and steer events on the WebSocket.
+//
+// The simulator speaks socket.io events with JSON data, e.g. `42["telemetry",{...}]`.
+//
+// Other clients may instead send binary WebSocket frames in the following format, and
+// are then replied to in the same format. All fields are little endian.
+//
+//   header:    u16 magic 0x424d ("MB"), u8 version 1, u8 type
+//   telemetry: header (type 1), f64 x, y, psi, speed, steering_angle, throttle,
+//              u32 n, f64 ptsx[n], f64 ptsy[n]
+//   steer:     header (type 2), f64 steering_angle, throttle,
+//              u32 m, f32 mpc_x[m], f32 mpc_y[m], u32 n, f32 next_x[n], f32 next_y[n]
+//
+// The trajectories of a steer event are for display only, so they are sent as f32.
+
+const uint16_t wire_magic = 0x424d;
+const uint8_t wire_version = 1;
+const uint8_t wire_type_telemetry = 1;
+const uint8_t wire_type_steer = 2;
+
+// Parse the JSON data of a telemetry event, i.e. the `[...]` part of `42[...]`.
+void parse_telemetry_json(const std::string & event, Telemetry & telemetry);
+
+// Format a steer event, including the leading `42`.
+std::string format_steer_json(const Actuation & actuation);
+
+// Whether a WebSocket frame is in the binary format, of any type.
+bool is_binary_message(const char *data, size_t length);
+
+// Return false if `data` is not a well-formed binary telemetry event.
+bool decode_telemetry(const char *data, size_t length, Telemetry & telemetry);
+
+void encode_telemetry(const Telemetry & telemetry, std::string & out);
+
+// Return false if `data` is not a well-formed binary steer event.
+// The trajectories are widened back from f32.
+bool decode_steer(const char *data, size_t length, Actuation & actuation);
+
+void encode_steer(const Actuation & actuation, std::string & out);
+
+#endif /* WIRE_H */